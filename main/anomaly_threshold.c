@@ -0,0 +1,200 @@
+#include "anomaly_threshold.h"
+#include <string.h>
+#include "nvs.h"
+#include "esp_log.h"
+
+#define TAG "THRESHOLD"
+
+#define THRESHOLD_NVS_NAMESPACE     "anomaly"
+#define THRESHOLD_NVS_KEY           "p2"
+#define THRESHOLD_VERSION           1
+
+//P2 estimator: marker heights, actual and desired positions. Saved as is in NVS.
+typedef struct{
+    uint32_t version;
+    uint32_t model_id;
+    float quantile;
+    uint32_t count;                 //Errors learned.
+    float height[5];
+    int32_t position[5];
+    double desired[5];              //Double, they grow by fractions for years.
+}p2_state_t;
+
+static p2_state_t state;
+static float default_value = 0.0f;
+static float threshold = 0.0f;
+static bool alarm = false;
+static uint32_t unsaved = 0;
+static volatile bool reset_requested = false;      //Set by anomaly_threshold_reset(), applied by the update.
+
+static void p2_reset(uint32_t model_id){
+    memset(&state, 0, sizeof(state));
+    state.version = THRESHOLD_VERSION;
+    state.model_id = model_id;
+    state.quantile = ANOMALY_QUANTILE;
+}
+
+//Parabolic prediction of marker i moved by d (-1 or +1).
+static float p2_parabolic(int i, int d){
+    const float* q = state.height;
+    const int32_t* n = state.position;
+    return q[i] + (float)d / (n[i + 1] - n[i - 1])
+        * ((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i])
+           + (n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+static void p2_add(float x){
+    float* q = state.height;
+    int32_t* n = state.position;
+    float p = state.quantile;
+    if(state.count < 5){
+        //The first five errors are the markers, kept sorted.
+        int i = state.count;
+        while((i > 0) && (q[i - 1] > x)){
+            q[i] = q[i - 1];
+            i--;
+        }
+        q[i] = x;
+        state.count++;
+        if(state.count == 5){
+            for(int m = 0; m < 5; m++){
+                n[m] = m;
+            }
+            state.desired[0] = 0.0;
+            state.desired[1] = 2.0 * p;
+            state.desired[2] = 4.0 * p;
+            state.desired[3] = 2.0 + 2.0 * p;
+            state.desired[4] = 4.0;
+        }
+        return;
+    }
+
+    int k;
+    if(x < q[0]){
+        q[0] = x;
+        k = 0;
+    }else if(x >= q[4]){
+        q[4] = x;
+        k = 3;
+    }else{
+        for(k = 0; x >= q[k + 1]; k++){
+        }
+    }
+    for(int m = k + 1; m < 5; m++){
+        n[m]++;
+    }
+    state.desired[1] += p / 2.0;
+    state.desired[2] += p;
+    state.desired[3] += (1.0 + p) / 2.0;
+    state.desired[4] += 1.0;
+
+    //Move the middle markers toward their desired position, one step at most.
+    for(int i = 1; i < 4; i++){
+        double delta = state.desired[i] - n[i];
+        if(((delta >= 1.0) && (n[i + 1] - n[i] > 1)) || ((delta <= -1.0) && (n[i - 1] - n[i] < -1))){
+            int d = (delta > 0.0) ? 1 : -1;
+            float height = p2_parabolic(i, d);
+            if((q[i - 1] < height) && (height < q[i + 1])){
+                q[i] = height;
+            }else{
+                q[i] += d * (q[i + d] - q[i]) / (n[i + d] - n[i]);
+            }
+            n[i] += d;
+        }
+    }
+    state.count++;
+}
+
+static void update_threshold(void){
+    if(state.count < ANOMALY_WARMUP){
+        threshold = default_value;
+    }else{
+        threshold = ANOMALY_MARGIN * state.height[2];
+    }
+}
+
+static void save_state(void){
+    nvs_handle_t nvs;
+    if(nvs_open(THRESHOLD_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK){
+        ESP_LOGW(TAG, "Failed to open NVS");
+        return;
+    }
+    if((nvs_set_blob(nvs, THRESHOLD_NVS_KEY, &state, sizeof(state)) != ESP_OK) || (nvs_commit(nvs) != ESP_OK)){
+        ESP_LOGW(TAG, "Failed to store the threshold state");
+    }
+    nvs_close(nvs);
+    unsaved = 0;
+}
+
+esp_err_t anomaly_threshold_init(uint32_t model_id, float default_threshold){
+    if(default_threshold <= 0.0f){
+        return ESP_ERR_INVALID_ARG;
+    }
+    default_value = default_threshold;
+    alarm = false;
+    unsaved = 0;
+    p2_reset(model_id);
+
+    nvs_handle_t nvs;
+    p2_state_t stored;
+    size_t size = sizeof(stored);
+    if(nvs_open(THRESHOLD_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK){
+        if((nvs_get_blob(nvs, THRESHOLD_NVS_KEY, &stored, &size) == ESP_OK) && (size == sizeof(stored))
+           && (stored.version == THRESHOLD_VERSION) && (stored.model_id == model_id)
+           && (stored.quantile == ANOMALY_QUANTILE)){
+            state = stored;
+        }
+        nvs_close(nvs);
+    }
+    update_threshold();
+    if(state.count >= ANOMALY_WARMUP){
+        ESP_LOGI(TAG, "Restored threshold %f (%" PRIu32 " errors learned)", threshold, state.count);
+    }else{
+        ESP_LOGI(TAG, "Learning, %" PRIu32 " of %d errors, default threshold %f", state.count, ANOMALY_WARMUP, threshold);
+    }
+    return ESP_OK;
+}
+
+bool anomaly_threshold_update(float mae){
+    if(reset_requested){
+        reset_requested = false;
+        p2_reset(state.model_id);
+        alarm = false;
+        update_threshold();
+        save_state();
+        ESP_LOGI(TAG, "Learned threshold forgotten, learning again");
+    }
+    bool learning = (state.count < ANOMALY_WARMUP);
+    //While learning every error is taken, the pump is assumed healthy at commissioning.
+    if(learning || (!alarm && (mae <= threshold))){
+        p2_add(mae);
+        update_threshold();
+        if((++unsaved >= ANOMALY_SAVE_PERIOD) || (learning && (state.count == ANOMALY_WARMUP))){
+            save_state();
+        }
+        if(learning && (state.count == ANOMALY_WARMUP)){
+            ESP_LOGI(TAG, "Learning done, threshold %f", threshold);
+        }
+    }
+
+    if(!alarm && (mae > threshold)){
+        alarm = true;
+        ESP_LOGW(TAG, "Alarm: error %f above %f", mae, threshold);
+    }else if(alarm && (mae < threshold * ANOMALY_CLEAR_RATIO)){
+        alarm = false;
+        ESP_LOGI(TAG, "Alarm cleared: error %f", mae);
+    }
+    return alarm;
+}
+
+float anomaly_threshold_get(void){
+    return threshold;
+}
+
+bool anomaly_threshold_learning(void){
+    return state.count < ANOMALY_WARMUP;
+}
+
+void anomaly_threshold_reset(void){
+    reset_requested = true;
+}
@@ -0,0 +1,46 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _ANOMALY_THRESHOLD_H_
+#define _ANOMALY_THRESHOLD_H_
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include "esp_err.h"
+
+#define ANOMALY_QUANTILE        0.99f       //Quantile of the reconstruction error tracked on this pump.
+#define ANOMALY_MARGIN          1.25f       //Alarm threshold = margin * quantile.
+#define ANOMALY_CLEAR_RATIO     0.8f        //The alarm clears below this fraction of the threshold.
+#define ANOMALY_WARMUP          360         //Errors learned before the threshold is used (60 min at one per 10 s burst).
+#define ANOMALY_SAVE_PERIOD     120         //Learned errors between two NVS saves.
+
+/*
+ * Per-device anomaly threshold.
+ * The reconstruction error of the healthy pump is tracked with a P2 quantile estimator
+ * (Jain & Chlamtac): five markers, constant memory and O(1) per error. Until ANOMALY_WARMUP
+ * errors are learned the default threshold is used. Errors taken while in alarm are not learned,
+ * so a fault does not become the new baseline. The estimator is saved in NVS and restored at boot.
+*/
+
+//Restore the state of model_id (any id of the model, a new id restarts the learning).
+esp_err_t anomaly_threshold_init(uint32_t model_id, float default_threshold);
+
+//Learn one reconstruction error and return the alarm state, with hysteresis.
+bool anomaly_threshold_update(float mae);
+
+//Threshold in use, the default one while learning.
+float anomaly_threshold_get(void);
+
+bool anomaly_threshold_learning(void);
+
+//Forget the learned baseline (pump serviced or replaced), learning starts over.
+//Safe from any task (MQTT command on pump/model/reset), it takes effect at the next update.
+void anomaly_threshold_reset(void);
+
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
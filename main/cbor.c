@@ -0,0 +1,159 @@
+#include "cbor.h"
+#include <math.h>
+#include <string.h>
+
+#define CBOR_MAJOR_UINT     0
+#define CBOR_MAJOR_NEGINT   1
+#define CBOR_MAJOR_TEXT     3
+#define CBOR_MAJOR_ARRAY    4
+#define CBOR_MAJOR_MAP      5
+#define CBOR_FALSE          0xf4
+#define CBOR_TRUE           0xf5
+#define CBOR_NULL           0xf6
+#define CBOR_FLOAT16        0xf9
+#define CBOR_FLOAT32        0xfa
+#define CBOR_HALF_MAX       65504.0f
+
+static void put(cbor_writer_t* w, const void* data, size_t len){
+    if(w->len + len <= w->size){
+        memcpy(&w->buf[w->len], data, len);
+    }else{
+        w->overflow = true;
+    }
+    w->len += len;
+}
+
+//Big endian, as CBOR wants it.
+static void put_be(cbor_writer_t* w, uint64_t value, int bytes){
+    uint8_t out[8];
+    for(int i = 0; i < bytes; i++){
+        out[i] = (uint8_t)(value >> (8 * (bytes - 1 - i)));
+    }
+    put(w, out, bytes);
+}
+
+//Initial byte of a data item and its argument in the shortest form.
+static void put_head(cbor_writer_t* w, uint8_t major, uint64_t value){
+    uint8_t initial = major << 5;
+    if(value < 24){
+        initial |= (uint8_t)value;
+        put(w, &initial, 1);
+    }else if(value <= UINT8_MAX){
+        initial |= 24;
+        put(w, &initial, 1);
+        put_be(w, value, 1);
+    }else if(value <= UINT16_MAX){
+        initial |= 25;
+        put(w, &initial, 1);
+        put_be(w, value, 2);
+    }else if(value <= UINT32_MAX){
+        initial |= 26;
+        put(w, &initial, 1);
+        put_be(w, value, 4);
+    }else{
+        initial |= 27;
+        put(w, &initial, 1);
+        put_be(w, value, 8);
+    }
+}
+
+void cbor_writer_init(cbor_writer_t* w, uint8_t* buf, size_t size){
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->overflow = false;
+}
+
+size_t cbor_writer_finish(cbor_writer_t* w){
+    return w->overflow ? 0 : w->len;
+}
+
+void cbor_map(cbor_writer_t* w, uint32_t pairs){
+    put_head(w, CBOR_MAJOR_MAP, pairs);
+}
+
+void cbor_array(cbor_writer_t* w, uint32_t count){
+    put_head(w, CBOR_MAJOR_ARRAY, count);
+}
+
+void cbor_uint(cbor_writer_t* w, uint64_t value){
+    put_head(w, CBOR_MAJOR_UINT, value);
+}
+
+void cbor_int(cbor_writer_t* w, int64_t value){
+    if(value < 0){
+        put_head(w, CBOR_MAJOR_NEGINT, (uint64_t)(-1 - value));
+    }else{
+        put_head(w, CBOR_MAJOR_UINT, (uint64_t)value);
+    }
+}
+
+void cbor_text(cbor_writer_t* w, const char* text){
+    size_t len = strlen(text);
+    put_head(w, CBOR_MAJOR_TEXT, len);
+    put(w, text, len);
+}
+
+void cbor_bool(cbor_writer_t* w, bool value){
+    uint8_t item = value ? CBOR_TRUE : CBOR_FALSE;
+    put(w, &item, 1);
+}
+
+void cbor_null(cbor_writer_t* w){
+    uint8_t item = CBOR_NULL;
+    put(w, &item, 1);
+}
+
+void cbor_float32(cbor_writer_t* w, float value){
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint8_t item = CBOR_FLOAT32;
+    put(w, &item, 1);
+    put_be(w, bits, 4);
+}
+
+uint16_t cbor_half_from_float(float value){
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    if(exponent == 0xff){
+        //Infinity, or a quiet NaN.
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    }
+    int32_t half_exponent = (int32_t)exponent - 127 + 15;
+    if(half_exponent >= 0x1f){
+        return sign | 0x7c00;                       //Overflow to infinity.
+    }
+    uint32_t shift;
+    if(half_exponent <= 0){
+        //Subnormal half: the implicit bit joins the mantissa, which shifts right.
+        if(half_exponent < -10){
+            return sign;                            //Below half the smallest subnormal.
+        }
+        mantissa |= 0x800000;
+        shift = 14 - half_exponent;
+        half_exponent = 0;
+    }else{
+        shift = 13;
+    }
+    uint32_t half_mantissa = mantissa >> shift;
+    uint32_t rest = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    uint32_t half = ((uint32_t)half_exponent << 10) + half_mantissa;
+    if((rest > halfway) || ((rest == halfway) && (half_mantissa & 1))){
+        half++;                                     //May carry into the exponent, which is right.
+    }
+    return sign | (uint16_t)half;
+}
+
+void cbor_float16(cbor_writer_t* w, float value){
+    if(isfinite(value) && (fabsf(value) > CBOR_HALF_MAX)){
+        cbor_float32(w, value);
+        return;
+    }
+    uint8_t item = CBOR_FLOAT16;
+    put(w, &item, 1);
+    put_be(w, cbor_half_from_float(value), 2);
+}
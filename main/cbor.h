@@ -0,0 +1,48 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _CBOR_H_
+#define _CBOR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+/*
+ * Minimal CBOR encoder (RFC 8949), definite lengths only.
+ * Same use as json_writer_t: values are streamed into a caller buffer, after an overflow the writer
+ * only counts and cbor_writer_finish() returns 0.
+*/
+typedef struct{
+    uint8_t* buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+}cbor_writer_t;
+
+void cbor_writer_init(cbor_writer_t* w, uint8_t* buf, size_t size);
+//Length of the encoded data, 0 if it did not fit.
+size_t cbor_writer_finish(cbor_writer_t* w);
+
+//Map of pairs key/value pairs, or array of count items, the items follow.
+void cbor_map(cbor_writer_t* w, uint32_t pairs);
+void cbor_array(cbor_writer_t* w, uint32_t count);
+void cbor_uint(cbor_writer_t* w, uint64_t value);
+void cbor_int(cbor_writer_t* w, int64_t value);
+void cbor_text(cbor_writer_t* w, const char* text);
+void cbor_bool(cbor_writer_t* w, bool value);
+void cbor_null(cbor_writer_t* w);
+void cbor_float32(cbor_writer_t* w, float value);
+//Half precision (11 significant bits), values beyond its range go out as float32.
+void cbor_float16(cbor_writer_t* w, float value);
+
+//IEEE 754 half precision of value, rounded to nearest even.
+uint16_t cbor_half_from_float(float value);
+
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
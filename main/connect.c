@@ -13,6 +13,9 @@
 #include "lwip/err.h"
 #include "lwip/sys.h"
 #include "modbus_rtu.h"
+#include "poll_scheduler.h"
+#include "main_functions.h"
+#include "anomaly_threshold.h"
 
 #define MAXIMUM_RETRY  10
 
@@ -22,6 +25,9 @@ char lwt_message[] = "disconnected";
 #define LWT_QOS 2
 #define LWT_RETAIN true
 
+//Any message on this topic forgets the learned anomaly threshold (pump serviced or replaced).
+#define THRESHOLD_RESET_TOPIC   "pump/model/reset"
+
 enum{
     CID_INPUT_X_SKEW = 0,                   //Floating point.
     CID_INPUT_Y_SKEW,                       //Floating point.      
@@ -42,7 +48,6 @@ const char *TAG = "Connect.c";
 
 extern EventGroupHandle_t events_group;
 extern QueueHandle_t messenger;
-extern TimerHandle_t modbus_read_timer_handle;
 
 typedef struct {
   char text[16];
@@ -51,6 +56,12 @@ typedef struct {
 
 static int s_retry_num = 0;
 
+static volatile bool mqtt_connected = false;
+
+//Ids of the last acknowledged publishes, the oldest is dropped when nobody takes them.
+#define PUBLISHED_QUEUE_LENGTH  8
+static QueueHandle_t published_ids = NULL;
+
 #define WIFI_CONNECTED_BIT      BIT0
 #define WIFI_FAIL_BIT           BIT1
 #define MQTT_CONNECTED_BIT      BIT2
@@ -211,7 +222,11 @@ static void mqtt_event_handler(void* arg, esp_event_base_t event_base,int32_t ev
             ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
             //esp_mqtt_client_subscribe(client, "Temp", 2);
             esp_mqtt_client_subscribe(client,"pump",2);
+            esp_mqtt_client_subscribe(client,THRESHOLD_RESET_TOPIC,2);
             esp_mqtt_client_publish(client, lwt_topic, "connected" , 0, 1, 1);
+            //Retained, so a model change that grows the arena shows on the broker.
+            esp_mqtt_client_publish(client, "pump/diag/arena", model_arena_report(), 0, 1, 1);
+            mqtt_connected = true;
             xEventGroupSetBits(events_group, MQTT_CONNECTED_BIT);
 
             //Oled
@@ -221,6 +236,7 @@ static void mqtt_event_handler(void* arg, esp_event_base_t event_base,int32_t ev
 
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+            mqtt_connected = false;
             xEventGroupSetBits(events_group, MQTT_DISCONNECT_BIT);
 
             //Oled
@@ -247,6 +263,11 @@ static void mqtt_event_handler(void* arg, esp_event_base_t event_base,int32_t ev
 
         case MQTT_EVENT_PUBLISHED:
             ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED");
+            if(xQueueSend(published_ids, &event->msg_id, 0) != pdPASS){
+                int oldest;
+                xQueueReceive(published_ids, &oldest, 0);
+                xQueueSend(published_ids, &event->msg_id, 0);
+            }
             xEventGroupSetBits(events_group, MQTT_PUBLISH_BIT);
 
             //Oled
@@ -258,19 +279,25 @@ static void mqtt_event_handler(void* arg, esp_event_base_t event_base,int32_t ev
             ESP_LOGI(TAG, "MQTT_EVENT_DATA");
             printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
             printf("DATA=%.*s\r\n", event->data_len, event->data);
+            if((event->topic_len == strlen(THRESHOLD_RESET_TOPIC))
+               && (strncmp(event->topic, THRESHOLD_RESET_TOPIC, event->topic_len) == 0)){
+                anomaly_threshold_reset();
+                send_to_oled("THRESHOLD RESET",true);
+                break;
+            }
             sprintf(mqtt_str,"%.*s",event->data_len,event->data);
             //Oled
 
             sprintf(str,"%.*s : %.*s",event->topic_len,event->topic,event->data_len,event->data);
             send_to_oled(str,true);
-            //We are subscribing to only one topic and it is "pump" sent by node-red dashboard and it sets the pump on/off.
+            //The other topic is "pump" sent by node-red dashboard and it sets the pump on/off.
             if(strcmp(mqtt_str,on)==0){
-                xTimerStart(modbus_read_timer_handle,portMAX_DELAY);
+                poll_scheduler_start();
                 bool value = true;
                 bool *ptr = &value;
                 write_modbus_data(CID_COIL_PUMP, (void *)ptr);
             }else{
-                xTimerStop(modbus_read_timer_handle,portMAX_DELAY);
+                poll_scheduler_stop();
                 bool value = false;
                 bool *ptr = &value;
                 write_modbus_data(CID_COIL_PUMP, (void *)ptr);
@@ -297,6 +324,30 @@ static void mqtt_event_handler(void* arg, esp_event_base_t event_base,int32_t ev
     }
 }
 
+int mqtt_publish(const char * topic,const char * payload,int qos,bool retain){
+    if(client == NULL){
+        return -1;
+    }
+    return esp_mqtt_client_publish(client, topic, payload, 0, qos, retain);
+}
+
+bool mqtt_is_connected(void){
+    return mqtt_connected;
+}
+
+bool mqtt_take_published(int msg_id){
+    int id;
+    if(published_ids == NULL){
+        return false;
+    }
+    while(xQueueReceive(published_ids, &id, 0) == pdPASS){
+        if(id == msg_id){
+            return true;
+        }
+    }
+    return false;
+}
+
 void mqtt_connect(const char * mqtt_id,const char * mqtt_password){
     esp_mqtt_client_config_t mqtt_cfg = {
     .broker = {
@@ -323,6 +374,7 @@ void mqtt_connect(const char * mqtt_id,const char * mqtt_password){
         .reconnect_timeout_ms = 10000,                                      //Optional reconnect time
     },
 };  
+    published_ids = xQueueCreate(PUBLISHED_QUEUE_LENGTH, sizeof(int));
     client = esp_mqtt_client_init(&mqtt_cfg);
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
     esp_mqtt_client_start(client);
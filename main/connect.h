@@ -10,6 +10,15 @@ void wifi_connect(const char * wifi_ssid,const char * wifi_password);
 void mqtt_connect(const char * mqtt_id,const char * mqtt_password);
 void send_to_oled(char *text,bool warning);
 
+//Publish on the broker from any task, returns the message id or -1 (not connected yet, queue full).
+int mqtt_publish(const char * topic,const char * payload,int qos,bool retain);
+
+//True between MQTT_EVENT_CONNECTED and MQTT_EVENT_DISCONNECTED.
+bool mqtt_is_connected(void);
+
+//True once the broker acknowledged msg_id (QoS 1 and 2), for a single consumer task.
+bool mqtt_take_published(int msg_id);
+
 
 #endif
 
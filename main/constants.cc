@@ -19,7 +19,7 @@ limitations under the License.
 const int kInferencesPerCycle = 20;
 
 const int input_size = 3;
-const float threshold = 0.13;
+const float threshold = 0.13;     //Used until the per-pump threshold is learned, see anomaly_threshold.h.
 const float x_skew_min = -0.282;
 const float x_skew_max = 0.701;
 const float y_skew_min = -0.575;
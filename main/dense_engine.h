@@ -0,0 +1,121 @@
+#ifndef _DENSE_ENGINE_H_
+#define _DENSE_ENGINE_H_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+// Fixed-shape inference for float models made only of FullyConnected layers
+// and their activations. Shapes and activations are template parameters and
+// the weights constexpr arrays (in flash), so every layer compiles to a fully
+// unrolled block of multiply-adds with no graph walk, no flatbuffer lookup
+// and no arena. The network constants come from tools/dense_codegen.py.
+namespace dense {
+
+enum class Activation { kNone, kRelu, kRelu6, kTanh, kLogistic };
+
+// Profiler tag of a layer, the name of the TFLite op it replaces.
+inline constexpr const char* kLayerTag = "FULLY_CONNECTED";
+
+template <Activation A>
+inline float Activate(float x) {
+  switch (A) {
+    case Activation::kRelu:
+      return (x > 0.0f) ? x : 0.0f;
+    case Activation::kRelu6:
+      return (x > 0.0f) ? ((x < 6.0f) ? x : 6.0f) : 0.0f;
+    case Activation::kTanh:
+      return tanhf(x);
+    case Activation::kLogistic:
+      return 1.0f / (1.0f + expf(-x));
+    default:
+      return x;
+  }
+}
+
+// y = activation(weights * x + bias), weights stored [outputs][inputs] as in
+// the TFLite FullyConnected op.
+template <int In, int Out, Activation A>
+struct Layer {
+  static constexpr int kInputs = In;
+  static constexpr int kOutputs = Out;
+
+  float weights[Out][In];
+  float bias[Out];
+
+  void Apply(const float* x, float* y) const {
+    ApplyRows(x, y, std::make_index_sequence<Out>());
+  }
+
+ private:
+  template <size_t... I>
+  static float Dot(const float* w, const float* x, std::index_sequence<I...>) {
+    return ((w[I] * x[I]) + ...);
+  }
+
+  template <size_t... O>
+  void ApplyRows(const float* x, float* y, std::index_sequence<O...>) const {
+    ((y[O] = Activate<A>(bias[O] + Dot(weights[O], x, std::make_index_sequence<In>()))), ...);
+  }
+};
+
+// Layers run in order, the activations between them live on the stack.
+template <typename First, typename... Rest>
+struct Network {
+  static constexpr int kInputs = First::kInputs;
+  static constexpr int kOutputs = Network<Rest...>::kOutputs;
+  static_assert(First::kOutputs == Network<Rest...>::kInputs, "Layer shapes do not chain");
+
+  First first;
+  Network<Rest...> rest;
+
+  void Invoke(const float* input, float* output) const {
+    float hidden[First::kOutputs];
+    first.Apply(input, hidden);
+    rest.Invoke(hidden, output);
+  }
+
+  // Same, every layer timed as one node of profiler (BeginEvent/EndEvent, e.g. an OpProfiler).
+  template <typename Profiler>
+  void Invoke(const float* input, float* output, Profiler* profiler) const {
+    float hidden[First::kOutputs];
+    uint32_t event = profiler->BeginEvent(kLayerTag);
+    first.Apply(input, hidden);
+    profiler->EndEvent(event);
+    rest.Invoke(hidden, output, profiler);
+  }
+};
+
+template <typename Last>
+struct Network<Last> {
+  static constexpr int kInputs = Last::kInputs;
+  static constexpr int kOutputs = Last::kOutputs;
+
+  Last last;
+
+  void Invoke(const float* input, float* output) const {
+    last.Apply(input, output);
+  }
+
+  template <typename Profiler>
+  void Invoke(const float* input, float* output, Profiler* profiler) const {
+    uint32_t event = profiler->BeginEvent(kLayerTag);
+    last.Apply(input, output);
+    profiler->EndEvent(event);
+  }
+};
+
+// FNV-1a of the source model, tells whether the generated constants are
+// still those of the linked flatbuffer.
+inline uint32_t ModelHash(const unsigned char* data, int length) {
+  uint32_t hash = 2166136261u;
+  for (int n = 0; n < length; n++) {
+    hash = (hash ^ data[n]) * 16777619u;
+  }
+  return hash;
+}
+
+}  // namespace dense
+
+#endif  // _DENSE_ENGINE_H_
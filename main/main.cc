@@ -7,7 +7,9 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
+#include "nvs.h"
 #include "mqtt_client.h"
 #include "esp_tls.h"
 #include "lwip/err.h"
@@ -17,9 +19,14 @@
 #include "driver/uart.h"
 #include "driver/gpio.h"
 #include "modbus_rtu.h"
-#include "cJSON.h"
+#include "modbus_async.h"
+#include "telemetry.h"
+#include "pump_data.h"
+#include "store_forward.h"
 #include <math.h>
 #include "main_functions.h"
+#include "poll_scheduler.h"
+#include "modbus_tcp_slave.h"
 
 #define WIFI_SSID      "change it"
 #define WIFI_PASS      "change it"
@@ -42,13 +49,33 @@ enum{
     CID_INPUT_CURRENT_DATA,                 //Floating point.
     CID_INPUT_FLOW_RATE_DATA,               //Floating point.
     CID_INPUT_TOTAL_FLOW_DATA,              //Floating point.
-    CID_COIL_PUMP                           //Pump ON or OFF.
+    CID_COIL_PUMP,                          //Pump ON or OFF.
+    POLL_WAVEFORM                           //Not a CID, the waveform burst is scheduled like one.
 };
 
 
-//Default time interval to read data from modbus slave and send it to mqtt server.
-int interval = 5000;     
-int timer_id = 1;          
+/*
+ * Pump controllers on the RS485 bus, they all share the same register map.
+ * The first one is the local pump, shown on the OLED and sent to the MQTT server.
+*/
+const uint8_t pump_slaves[] = { 1, 2, 3 };
+
+/*
+ * Poll table: each point is read at its own period (ms) and must be served within its deadline (ms).
+ * Vibration and current change fast, the total flow barely moves.
+ * The pump status period is also the period of the JSON message sent to the MQTT server.
+*/
+const poll_point_t poll_table[] = {
+  //ID                          Period    Deadline
+  { CID_INPUT_X_SKEW,           1000,     500  },
+  { CID_INPUT_Y_SKEW,           1000,     500  },
+  { CID_INPUT_Z_SKEW,           1000,     500  },
+  { CID_INPUT_CURRENT_DATA,     1000,     500  },
+  { CID_INPUT_FLOW_RATE_DATA,   5000,     1000 },
+  { CID_INPUT_TOTAL_FLOW_DATA,  30000,    5000 },
+  { CID_COIL_PUMP,              5000,     1000 },
+  { POLL_WAVEFORM,              10000,    5000 }
+};
 
 extern esp_mqtt_client_handle_t client;
 
@@ -84,24 +111,80 @@ typedef struct {
 
 
 /*
- * This variabe will be used to queue data needed for json messeges from get_data_from_MODBUS_slave to MQTT_sender
+ * Payload format of each topic. A CBOR topic gets a "/cbor" suffix so JSON subscribers never see it.
+ * The messages and their schema are in pump_data.h.
 */
-typedef struct {
-  bool pump;
-  float current;
-  float flow_rate;
-  float total_flow;
-}JSON_DATA_t;
+#define PUBLISH_DATA_FORMAT     TELEMETRY_JSON
+#define PUBLISH_BATCH_FORMAT    TELEMETRY_JSON
+#define BOOT_NVS_NAMESPACE      "telemetry"
+#define BOOT_NVS_KEY            "boot"
+
+/*
+ * Batched publishing: samples are accumulated up to PUBLISH_BATCH_SIZE, or PUBLISH_BATCH_MS after the
+ * first one, and go out as one columnar message on PUBLISH_BATCH_TOPIC:
+ * {"boot":..,"uptime_ms":..,"t0":..,"dt":[..],"pump":[..],"current":[..],"flow_rate":[..],"total_flow":[..],"status":[..]}
+ * t0 is the time (ms since boot) of the first sample and dt the offset of each sample from it,
+ * uptime_ms the time of the publish, so the receiver can place the samples on its own clock.
+ * PUBLISH_BATCH_SIZE 1 (default) keeps one object per sample on pump/data. Sites on a metered or
+ * cellular link set it to 12 (one minute at the 5 s pump status period) to save the per message overhead.
+*/
+#define PUBLISH_BATCH_SIZE      1
+#define PUBLISH_BATCH_MS        60000         //Longest delay of a sample.
+#define PUBLISH_BATCH_TOPIC     "pump/data/batch"
+#define PUBLISH_BUFFER_SIZE     (128 + PUBLISH_BATCH_SIZE * 64)
+
+/*
+ * Report by exception: a sample is published only when a field left its deadband around the last
+ * published sample, or PUBLISH_HEARTBEAT_MS after it so a steady pump is still seen alive.
+ * The samples in between are not sent, the receiver holds the last value. A change of the anomaly
+ * status goes out at once with the samples batched so far. PUBLISH_HEARTBEAT_MS 0 sends every sample.
+*/
+#define PUBLISH_HEARTBEAT_MS    300000
+static const telemetry_deadband_t pump_data_deadbands[] = {
+  TELEMETRY_ON_CHANGE,                    //pump
+  TELEMETRY_DEADBAND(0.05f, 2.0f),        //current
+  TELEMETRY_DEADBAND(0.02f, 2.0f),        //flow_rate
+  TELEMETRY_DEADBAND(1.0f, 0.0f),         //total_flow
+  TELEMETRY_ALARM,                        //status
+};
+static_assert(sizeof(pump_data_deadbands) / sizeof(pump_data_deadbands[0]) == PUMP_DATA_FIELDS,
+              "One deadband per field of pump_data_fields");
+
+//Topics of the telemetry, a message is kept in the store and forward log with its index in front.
+enum{
+  TOPIC_DATA = 0,
+  TOPIC_DATA_CBOR,
+  TOPIC_BATCH,
+  TOPIC_BATCH_CBOR,
+  TOPIC_COUNT
+};
+static const char* const publish_topics[TOPIC_COUNT] = {
+  "pump/data", "pump/data/cbor", PUBLISH_BATCH_TOPIC, PUBLISH_BATCH_TOPIC "/cbor"
+};
 
 /*
- * We will get MPU sensor reading on each asix using modbus.
+ * Store and forward: while the broker is unreachable the messages go to the "telemetry" flash
+ * partition and are replayed once it is back, oldest first, one at a time: the next one leaves
+ * STORE_REPLAY_INTERVAL_MS after the broker acknowledged the previous, so the backlog does not
+ * crowd out the live messages. New messages queue behind the backlog to keep the order.
+ * A stored message keeps the boot number and uptime_ms of its encoding, it is older than its arrival.
 */
+#define STORE_REPLAY_INTERVAL_MS    200
+#define STORE_REPLAY_TIMEOUT_MS     10000     //Publish again when the acknowledgement does not come.
+static_assert(1 + PUBLISH_BUFFER_SIZE <= STORE_RECORD_MAX, "A batch must fit in one stored record");
 
-typedef struct{
-  float x;
-  float y;
-  float z;
-}MPU_skew_t;
+/*
+ * Feature windows over the MPU waveform: one vector every hop samples of each axis.
+ * The bursts are 10 s apart, so a window never spans two of them: it is one whole burst
+ * (128 samples per axis) and the windows start over with every burst.
+*/
+#define FEATURE_WINDOW      samples
+#define FEATURE_HOP         samples
+#define FEATURE_SCALE       1.0f          //Raw MPU counts.
+
+//Spectral bands are centred on the harmonics of the pump shaft.
+#define MPU_SAMPLE_RATE_HZ  1000.0f
+#define PUMP_ROTATION_HZ    24.0f         //1450 rpm motor.
 
 
 
@@ -118,9 +201,9 @@ QueueHandle_t JSON_msg;
 
 
 /*
- * This Queue will be used in the loop() in main_function.cc queueing the input data to the autoencoder.
+ * This Queue will be used in the loop() in main_function.cc queueing the feature vectors to the autoencoder.
 */
-QueueHandle_t skew_queue;
+QueueHandle_t features_queue;
 
 
 /*
@@ -129,15 +212,13 @@ QueueHandle_t skew_queue;
 QueueHandle_t autoencoder;
 
 
-TaskHandle_t get_data_from_MODBUS_slave_handle;
+/*
+ * This Queue holds the latest waveform capture (a pointer into the capture ring in modbus_rtu.c).
+*/
+QueueHandle_t waveform_queue;
 
-TimerHandle_t modbus_read_timer_handle;
 
-void data_timer_cb( TimerHandle_t xTimer ){
-  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-  vTaskNotifyGiveFromISR(get_data_from_MODBUS_slave_handle, &xHigherPriorityTaskWoken);
-  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
-}
+TaskHandle_t get_data_from_MODBUS_slave_handle;
 
 /*
  * Display task to display message from other tasks on SSD1306.
@@ -161,102 +242,304 @@ void display(void *parameter){
 }
 
 
+static uint32_t boot_count = 0;
+
+//Number this boot in NVS, 0 when NVS fails.
+static uint32_t count_boot(void){
+  nvs_handle_t nvs;
+  uint32_t boot = 0;
+  if(nvs_open(BOOT_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK){
+    printf("Boot counter unavailable\n");
+    return 0;
+  }
+  nvs_get_u32(nvs, BOOT_NVS_KEY, &boot);
+  boot++;
+  if((nvs_set_u32(nvs, BOOT_NVS_KEY, boot) != ESP_OK) || (nvs_commit(nvs) != ESP_OK)){
+    printf("Boot counter not saved\n");
+  }
+  nvs_close(nvs);
+  return boot;
+}
+
+//Send the message in record (topic index, payload), or keep it in flash when it cannot go now.
+static void publish_or_store(const char* record, size_t length){
+  //Behind stored messages a new one waits its turn.
+  if((store_forward_pending() == 0) && mqtt_is_connected()
+     && (esp_mqtt_client_publish(client, publish_topics[(uint8_t)record[0]], &record[1], length - 1, 1, 0) >= 0)){
+    return;
+  }
+  esp_err_t err = store_forward_append(record, length);
+  if(err != ESP_OK){
+    printf("Message of %u bytes lost : %s\n", (unsigned)length, esp_err_to_name(err));
+  }
+}
+
+//Replay of the stored messages, one in flight at a time. Returns the time (us) it wants to run again, 0 when idle.
+static int64_t replay_stored(char* record, size_t size){
+  static int replay_id = -1;
+  static int64_t sent = 0;
+  static int64_t due = 0;
+  int64_t now = esp_timer_get_time();
+  if(!mqtt_is_connected() || (store_forward_pending() == 0)){
+    replay_id = -1;           //The client resends its own outbox after a reconnect, duplicates are possible.
+    return 0;
+  }
+  if(replay_id >= 0){
+    if(mqtt_take_published(replay_id)){
+      store_forward_ack();
+      replay_id = -1;
+      due = now + (int64_t)STORE_REPLAY_INTERVAL_MS * 1000;
+    }else if(now - sent < (int64_t)STORE_REPLAY_TIMEOUT_MS * 1000){
+      return now + (int64_t)STORE_REPLAY_INTERVAL_MS * 1000;
+    }
+  }
+  if(now < due){
+    return due;
+  }
+  uint16_t length = 0;
+  esp_err_t err = store_forward_peek(record, size, &length);
+  if(err == ESP_ERR_NOT_FOUND){
+    return 0;
+  }
+  if((err != ESP_OK) || (length < 2) || ((uint8_t)record[0] >= TOPIC_COUNT)){
+    printf("Stored message skipped : %s\n", esp_err_to_name(err));
+    store_forward_ack();
+    return now;
+  }
+  replay_id = esp_mqtt_client_publish(client, publish_topics[(uint8_t)record[0]], &record[1], length - 1, 1, 0);
+  sent = now;
+  due = now + (int64_t)STORE_REPLAY_INTERVAL_MS * 1000;
+  return due;
+}
+
 void MQTT_sender(void *parameter){
-  JSON_DATA_t data;
-  bool result;
+  static JSON_DATA_t batch[PUBLISH_BATCH_SIZE];
+  static char record[1 + PUBLISH_BUFFER_SIZE];      //Topic index then payload, reused for every message.
+  char* payload = &record[1];
+  const size_t payload_size = sizeof(record) - 1;
+  JSON_DATA_t published = {};                       //Last sample taken into a batch, the deadband reference.
+  bool published_once = false;
+  uint16_t count = 0;
+  int64_t deadline = 0;
+  int64_t replay_at = 0;
+  boot_count = count_boot();
+  if(store_forward_init() != ESP_OK){
+    send_to_oled("STORE ERROR",true);
+  }
   while(1){
-    if(xQueueReceive(JSON_msg,&data,portMAX_DELAY) == pdPASS){
-      cJSON *root = cJSON_CreateObject();
-      cJSON_AddStringToObject(root, "pump", data.pump?"on":"off");
-      cJSON_AddNumberToObject(root, "current", data.current);
-      cJSON_AddNumberToObject(root, "flow_rate",data.flow_rate);
-      cJSON_AddNumberToObject(root, "total_flow", data.total_flow);
-      xQueueReceive(autoencoder,&result,portMAX_DELAY);
-      if (result){
-        cJSON_AddStringToObject(root, "status", "normal");
+    //Wait for the next sample, or until the batch or the next replay is due.
+    int64_t wake = (count > 0) ? deadline : 0;
+    if((replay_at > 0) && ((wake == 0) || (replay_at < wake))){
+      wake = replay_at;
+    }
+    TickType_t wait = portMAX_DELAY;
+    if(wake > 0){
+      int64_t left_ms = (wake - esp_timer_get_time()) / 1000;
+      wait = (left_ms > 0) ? pdMS_TO_TICKS(left_ms) : 0;
+    }
+    if(xQueueReceive(JSON_msg,&batch[count],wait) == pdPASS){
+      xQueuePeek(autoencoder,&batch[count].anomaly,0);     //Latest inference result, true in alarm.
+      telemetry_exception_t exception = TELEMETRY_OUTSIDE;
+      if(published_once){
+        exception = telemetry_check_deadbands(pump_data_fields, pump_data_deadbands,
+                                              PUMP_DATA_FIELDS, &published, &batch[count]);
+      }
+      if((exception != TELEMETRY_INSIDE) || (PUBLISH_HEARTBEAT_MS == 0)
+         || (batch[count].time_ms - published.time_ms >= PUBLISH_HEARTBEAT_MS)){
+        published = batch[count];
+        published_once = true;
+        if(count == 0){
+          deadline = esp_timer_get_time() + (int64_t)PUBLISH_BATCH_MS * 1000;
+        }
+        if(exception == TELEMETRY_IMMEDIATE){
+          deadline = esp_timer_get_time();
+        }
+        count++;
+      }
+    }
+    replay_at = replay_stored(record, sizeof(record));
+    if((count == 0) || ((count < PUBLISH_BATCH_SIZE) && (esp_timer_get_time() < deadline))){
+      continue;
+    }
+
+    size_t length;
+    pump_data_header_t header = { boot_count, esp_timer_get_time() / 1000 };
+    if(PUBLISH_BATCH_SIZE == 1){
+      if(PUBLISH_DATA_FORMAT == TELEMETRY_CBOR){
+        length = sample_to_cbor(&header, &batch[0], (uint8_t*)payload, payload_size);
+        record[0] = TOPIC_DATA_CBOR;
       }else{
-        cJSON_AddStringToObject(root, "status", "Anomaly");
+        length = sample_to_json(&header, &batch[0], payload, payload_size);
+        record[0] = TOPIC_DATA;
       }
-      char *json_string = cJSON_PrintUnformatted(root);
-      if (json_string) {
-        esp_mqtt_client_publish(client, "pump/data", json_string, 0, 1, 0); //Publish JSON string to MQTT.
-        free(json_string); 
+    }else{
+      if(PUBLISH_BATCH_FORMAT == TELEMETRY_CBOR){
+        length = batch_to_cbor(&header, batch, count, (uint8_t*)payload, payload_size);
+        record[0] = TOPIC_BATCH_CBOR;
+      }else{
+        length = batch_to_json(&header, batch, count, payload, payload_size);
+        record[0] = TOPIC_BATCH;
       }
-      cJSON_Delete(root);
     }
+    if (length > 0) {
+      publish_or_store(record, 1 + length);   //Publish the payload to MQTT, or keep it for later.
+    }else{
+      printf("Batch of %u samples does not fit in %u bytes\n", (unsigned)count, (unsigned)payload_size);
+    }
+    count = 0;
   }
 }
 
 /*
- * Read data from modbus slave periodiclly.
+ * Read data from modbus slave, each point at the rate set in poll_table.
 */
 void get_data_from_MODBUS_slave(void *parameter){
   error_t err;
+  err = modbus_set_slaves(pump_slaves, sizeof(pump_slaves)/sizeof(pump_slaves[0]));
+  if(err !=ESP_OK){
+    printf("Modbus slave list Error : %d\n",err);
+    return;
+  }
   err = modbusRTU_init(9600);     //Using UART2.
   if(err !=ESP_OK){
     printf("Initializing Modbus RTU Error : %d\n",err);
     return;
   }
   send_to_oled("Modbus OK", false);
+  uint32_t baudrate = 0;
+  if(modbus_negotiate_baudrate(&baudrate) == ESP_OK){
+    char baud_str [16];
+    sprintf(baud_str, "Baud : %" PRIu32, baudrate);
+    send_to_oled(baud_str,false);
+  }
   JSON_DATA_t JSON_data;
-  MPU_skew_t axis;
+  vibration_vector_t vector;
+  uint32_t mb_alloc_count = 0;
+  uint32_t mb_scratch_count = 0;
+  bool due[POLL_MAX_POINTS];
+  bool waveform_due = false;
   while(1){
-    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-    printf("Timer expired. Performing Modbus data acquisition.\n");
-    void* data = NULL;
-    data = read_modbus_data(CID_COIL_PUMP);
-    
-    if(data == NULL) { //Failed to get parameter.
+    //The waveform burst is the last read of a cycle, it is reported served once the cycle is over.
+    if(waveform_due){
+      bool served[POLL_MAX_POINTS] = {};
+      served[POLL_WAVEFORM] = true;
+      poll_scheduler_done(served);
+      waveform_due = false;
+    }
+    poll_scheduler_wait(due);
+    printf("Points due. Performing Modbus data acquisition.\n");
+
+    //Steady-state polling should never allocate in the Modbus tasks, report it if it does.
+    //The scratch count is the share of the master's parameter path (its buffer pool ran dry).
+    uint32_t alloc_count = modbus_async_alloc_count();
+    uint32_t scratch_count = 0;
+    mbc_master_get_scratch_alloc_count(&scratch_count);
+    if((alloc_count != mb_alloc_count) || (scratch_count != mb_scratch_count)){
+      printf("Modbus poll heap allocations : %" PRIu32 ", master scratch : %" PRIu32 "\n", alloc_count, scratch_count);
+      mb_alloc_count = alloc_count;
+      mb_scratch_count = scratch_count;
+    }
+
+    //Due points that share a block of registers are read in one request.
+    err = read_modbus_due(due);
+    bool served[POLL_MAX_POINTS];
+    memcpy(served, due, sizeof(served));
+    served[POLL_WAVEFORM] = false;
+    poll_scheduler_done(served);
+    waveform_due = due[POLL_WAVEFORM];
+    if(due[CID_COIL_PUMP]){
+      //Bus health, one line per slave.
+      modbus_slave_health_t health;
+      for(uint8_t slave = 0; slave < modbus_slave_count(); slave++){
+        if(modbus_get_slave_health(slave, &health) == ESP_OK){
+          printf("Slave %u %s : %" PRIu32 " req, %" PRIu32 " err (%" PRIu32 " timeouts), latency avg %" PRIu32 " us max %" PRIu32 " us, timeout %" PRIu32 " ms\n",
+                 health.addr, health.online ? "online" : "offline", health.requests, health.errors, health.timeouts,
+                 health.avg_latency_us, health.max_latency_us, health.timeout_ms);
+        }
+      }
+      //Deadline misses since boot, one count per point of poll_table.
+      printf("Deadline misses :");
+      for(size_t i = 0; i < sizeof(poll_table)/sizeof(poll_table[0]); i++){
+        printf(" %u:%" PRIu32, poll_table[i].id, poll_scheduler_misses(poll_table[i].id));
+      }
+      printf("\n");
+    }
+    if(err != ESP_OK) { //Failed to get parameters.
       send_to_oled("MB ERROR",true);
-      continue;                       
+      continue;
     }
 
+    //One consistent copy of the local pump, the request task may already be decoding the next poll.
+    modbus_point_t points[CID_COIL_PUMP + 1];
+    get_modbus_points(0, CID_INPUT_X_SKEW, CID_COIL_PUMP + 1, points);
 
-    //Get PUMP status.
-    bool value = modbus_data_to_bool(data);
     char str [16];
-    sprintf(str, "PUMP : %s", value? "ON":"OFF");
-    
-    send_to_oled(str,false);
-    JSON_data.pump = modbus_data_to_bool(data);
+    if(due[CID_COIL_PUMP]){
+      //Get PUMP status.
+      bool value = modbus_data_to_bool(points[CID_COIL_PUMP].value);
+      sprintf(str, "PUMP : %s", value? "ON":"OFF");
+      send_to_oled(str,false);
+
+      //If the pump is off Stop getting data. 
+      if(!value){ 
+        poll_scheduler_stop();
+        continue;
+      }
+    }
 
-    //If the pump is off Stop getting data. 
-    if(!value){ 
-      xTimerStop(modbus_read_timer_handle,portMAX_DELAY);
-      continue;
+    if(due[CID_INPUT_CURRENT_DATA]){
+      sprintf(str, "Cur : %.2f A", modbus_data_to_float(points[CID_INPUT_CURRENT_DATA].value));
+      send_to_oled(str,false);
     }
 
-    //Get pump current.
-    data = read_modbus_data(CID_INPUT_CURRENT_DATA);
-    sprintf(str, "Cur : %.2f A", modbus_data_to_float(data));
-    send_to_oled(str,false);
-    JSON_data.current = modbus_data_to_float(data);
+    if(due[CID_INPUT_FLOW_RATE_DATA]){
+      sprintf(str, "Q : %.2f mil/s", modbus_data_to_float(points[CID_INPUT_FLOW_RATE_DATA].value));
+      send_to_oled(str,false);
+    }
 
-    //Get flow rate.
-    data = read_modbus_data(CID_INPUT_FLOW_RATE_DATA);
-    sprintf(str, "Q : %.2f mil/s", modbus_data_to_float(data));
-    send_to_oled(str,false);
-    
-    JSON_data.flow_rate = modbus_data_to_float(data);
+    if(due[CID_INPUT_TOTAL_FLOW_DATA]){
+      sprintf(str, "V : %.2f mil", modbus_data_to_float(points[CID_INPUT_TOTAL_FLOW_DATA].value));
+      send_to_oled(str,false);
+    }
 
-    //Get total flow.
-    data = read_modbus_data(CID_INPUT_TOTAL_FLOW_DATA);
-    sprintf(str, "V : %.2f mil", modbus_data_to_float(data));
-    send_to_oled(str,false);
-    JSON_data.total_flow = modbus_data_to_float(data);
-    
+    //The JSON message goes out at the pump status rate with the latest value of every field.
+    if(due[CID_COIL_PUMP]){
+      JSON_data.pump = modbus_data_to_bool(points[CID_COIL_PUMP].value);
+      JSON_data.current = modbus_data_to_float(points[CID_INPUT_CURRENT_DATA].value);
+      JSON_data.flow_rate = modbus_data_to_float(points[CID_INPUT_FLOW_RATE_DATA].value);
+      JSON_data.total_flow = modbus_data_to_float(points[CID_INPUT_TOTAL_FLOW_DATA].value);
+      JSON_data.time_ms = points[CID_COIL_PUMP].timestamp / 1000;
+      xQueueSendToBack(JSON_msg,(void *)&JSON_data,portMAX_DELAY);
+    }
 
-    xQueueSendToBack(JSON_msg,(void *)&JSON_data,portMAX_DELAY);
-
-    //Get MPU data.
-    void * skew_data;
-    skew_data = read_modbus_data(CID_INPUT_X_SKEW);
-    axis.x = modbus_data_to_float(skew_data);
-    skew_data = read_modbus_data(CID_INPUT_Y_SKEW);
-    axis.y = modbus_data_to_float(skew_data);
-    skew_data = read_modbus_data(CID_INPUT_Z_SKEW);
-    axis.z = modbus_data_to_float(skew_data);
-    xQueueSend(skew_queue,(void *)&axis,portMAX_DELAY);
+    //Get MPU waveform.
+    if(due[POLL_WAVEFORM]){
+      waveform_reg_params_t* capture = read_modbus_waveform();
+      if(capture == NULL){
+        send_to_oled("WAVE ERROR",true);
+        continue;
+      }
+      xQueueOverwrite(waveform_queue,(void *)&capture);
+
+      //Band energies of the burst, then stream it through the feature windows.
+      //Each completed hop goes to the autoencoder with the spectrum of this burst and the skew
+      //registers of the slave, the input the current model was trained on.
+      const int16_t* axes[VIBRATION_AXES] = { capture->input_x, capture->input_y, capture->input_z };
+      if(vibration_spectrum_compute(axes, &vector.spectrum) != ESP_OK){
+        send_to_oled("FFT ERROR",true);
+        continue;
+      }
+      for(int axis = 0; axis < VIBRATION_AXES; axis++){
+        vector.register_skew[axis] = modbus_data_to_float(points[CID_INPUT_X_SKEW + axis].value);
+      }
+      vibration_features_reset();
+      for(int n = 0; n < samples; n++){
+        const int16_t sample[VIBRATION_AXES] = { capture->input_x[n], capture->input_y[n], capture->input_z[n] };
+        if(vibration_features_add(sample, &vector.features) && (xQueueSend(features_queue,(void *)&vector,0) != pdPASS)){
+          printf("Feature vector %" PRIu32 " dropped, inference is behind\n", vector.features.seq);
+        }
+      }
+    }
   }
 }
 
@@ -281,20 +564,27 @@ extern "C" {void app_main(void)
     events_group = xEventGroupCreate();
 
     autoencoder = xQueueCreate(1,sizeof(bool));
+    bool normal = false;
+    xQueueOverwrite(autoencoder,&normal);     //No alarm until the first inference.
     messenger = xQueueCreate(10,sizeof(messages_t));
-    skew_queue = xQueueCreate(1,sizeof(MPU_skew_t));
+    features_queue = xQueueCreate(INFERENCE_BATCH_MAX,sizeof(vibration_vector_t));
     JSON_msg = xQueueCreate(2,sizeof(JSON_DATA_t));
+    waveform_queue = xQueueCreate(1,sizeof(waveform_reg_params_t*));
  
-    modbus_read_timer_handle = xTimerCreate("data_timer",pdMS_TO_TICKS(interval),pdTRUE,NULL, data_timer_cb );
+    ESP_ERROR_CHECK(poll_scheduler_init(poll_table, sizeof(poll_table)/sizeof(poll_table[0])));
+    ESP_ERROR_CHECK(vibration_features_init(FEATURE_WINDOW, FEATURE_HOP, FEATURE_SCALE));
+    ESP_ERROR_CHECK(vibration_spectrum_init(MPU_SAMPLE_RATE_HZ, PUMP_ROTATION_HZ));
     setup();
 
-    xTimerStop(modbus_read_timer_handle,portMAX_DELAY);
-
     xTaskCreatePinnedToCore(MQTT_sender,"mqtt_sender",6144,NULL,1,NULL,1);
     xTaskCreatePinnedToCore(display,"oled_display",5120,NULL,1,NULL,1);
     vTaskDelay(1000 / portTICK_PERIOD_MS);
 
     wifi_connect(WIFI_SSID,WIFI_PASS);
+    //SCADA reads the pump registers here, from the cache of the RTU poll.
+    if(modbus_tcp_slave_start() != ESP_OK){
+      send_to_oled("MB TCP ERROR",true);
+    }
     vTaskDelay(pdMS_TO_TICKS(2000));
     mqtt_connect(MQTT_ID,MQTT_PASSWORD);
 
@@ -304,11 +594,5 @@ extern "C" {void app_main(void)
       loop();
     }
 
-      
-    /*
-    if (modbus_read_timer_handle != NULL) {
-      xTimerStart(modbus_read_timer_handle, 0);
-    }
-    */
 }
 }
@@ -21,128 +21,511 @@ limitations under the License.
 
 #include "main_functions.h"
 #include "model.h"
+#include "model_dense.h"
 #include "constants.h"
+#include "anomaly_threshold.h"
+#include "model_kernels.h"
+#include "connect.h"
+#include "op_profiler.h"
 //#include "output_handler.h"
 #include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "sdkconfig.h"
+#include <string.h>
+#include <new>
 
 
 #define AXIS  3
+#define FEATURES_PER_AXIS   (sizeof(axis_features_t) / sizeof(float))
+#define MAX_INPUTS          (AXIS * (FEATURES_PER_AXIS + SPECTRUM_BANDS))
+#define BATCH_FLUSH_MS      30000         //Longest wait for a full batch, a partial one is run after it.
 
-extern QueueHandle_t skew_queue;
-extern QueueHandle_t autoencoder;
+/*
+ * Arena sizing mode: set to 1 to run the model on the recording interpreter in a large scratch
+ * arena instead of the plain interpreter in its static one. The boot report then gives the
+ * breakdown of the arena and the smallest arena the plain interpreter allocates in, the figure
+ * for kTensorArenaSize. The recording allocator costs RAM and a few us per invoke, ship with 0.
+*/
+#define ARENA_SIZING        0
+#define ARENA_SIZING_SIZE   (32 * 1024)
+#define ARENA_SLACK_MAX     512           //Static arena above the smallest one by more is reported as waste.
+
+#if ARENA_SIZING
+#include "tensorflow/lite/micro/recording_micro_interpreter.h"
+typedef tflite::RecordingMicroInterpreter Interpreter;
+#else
+typedef tflite::MicroInterpreter Interpreter;
+#endif
 
-typedef struct{
-  float x;
-  float y;
-  float z;
-}MPU_skew_t;
+/*
+ * Per operator profiling: set to 1 to time every op of the model. Every PROFILE_PERIOD invokes
+ * the min/avg/max of each node is printed and published on PROFILE_TOPIC. On the dense engine
+ * every layer is one node and every row one invoke.
+*/
+#define OP_PROFILING        0
+#define PROFILE_PERIOD      20
+#define PROFILE_TOPIC       "pump/diag/profile"
 
-MPU_skew_t skew;
+/*
+ * Generated dense engine (model_dense.h, tools/dense_codegen.py): the float model runs as unrolled
+ * constexpr layers instead of through the interpreter, once the boot benchmark found both agree.
+ * The interpreter stays set up as the fallback for a stale or diverging header.
+*/
+#define DENSE_ENGINE        1
+#define DENSE_BENCH_RUNS    200
+#define DENSE_TOLERANCE     1e-5f
+
+extern QueueHandle_t features_queue;
+extern QueueHandle_t autoencoder;
+
+vibration_vector_t vectors[INFERENCE_BATCH_MAX];
 
 // Globals, used for compatibility with Arduino-style sketches.
 namespace {
-const tflite::Model* model = nullptr;
-tflite::MicroInterpreter* interpreter = nullptr;
-TfLiteTensor* input = nullptr;
-TfLiteTensor* output = nullptr;
 
+// The autoencoder g_model. A full-integer conversion of it (int8 input and output)
+// is (de)quantized here.
+struct Autoencoder {
+  const char* name;
+  const tflite::Model* model;
+  Interpreter* interpreter;
+  TfLiteTensor* input;
+  TfLiteTensor* output;
+  int input_count;
+  int batch;                      // Rows of the input tensor, first dimension of a batched export.
+  int64_t latency_sum_us;
+  size_t arena_size;
+  OpProfiler* profiler;           // nullptr unless OP_PROFILING.
+  size_t arena_minimum;           // Smallest arena that allocates, ARENA_SIZING only.
+  bool dense;                     // Runs on dense::kModel instead of the interpreter.
+  alignas(Interpreter) uint8_t interpreter_buffer[sizeof(Interpreter)];
+};
 
-constexpr int kTensorArenaSize = 2000;
-uint8_t tensor_arena[kTensorArenaSize];
-}  // namespace
+Autoencoder float_model = {"float"};
+Autoencoder* active = nullptr;    // Set once the model is set up.
 
-// The name of this function is important for Arduino compatibility.
-void setup() {
-  // Map the model into a usable data structure. This doesn't involve any
-  // copying or parsing, it's a very lightweight operation.
-  model = tflite::GetModel(g_model);
-  if (model->version() != TFLITE_SCHEMA_VERSION) {
+// Smallest arena the float model allocates in with the plain interpreter, see ARENA_SIZING.
+// Measured on a 64-bit host: 1792 bytes, of which 1216 stay used after AllocateTensors() and the
+// rest are the temporary buffers of the memory planner. Pointers are half that size on the ESP32,
+// so this is an upper bound until the on-target sizing report replaces it.
+constexpr int kTensorArenaSize = 1792;
+alignas(16) uint8_t tensor_arena[kTensorArenaSize];
+#if ARENA_SIZING
+uint8_t sizing_arena[ARENA_SIZING_SIZE];
+#endif
+
+#if OP_PROFILING
+OpProfiler float_profiler("float");
+char profile_report[768];
+#endif
+
+// Arena breakdown of the model, JSON published at boot.
+char arena_report[320] = "{}";
+
+// FullyConnected comes from esp-nn, int8 included; Quantize/Dequantize are only there
+// for quantized models converted with float I/O.
+tflite::MicroMutableOpResolver<4> resolver;
+
+// Arena use of one model. With ARENA_SIZING the recording allocator splits it into head (non
+// persistent, reused between ops), tail (persistent: tensors, op data, buffers) and allocation types.
+void ReportArena(const Autoencoder* a) {
+  size_t used = a->interpreter->arena_used_bytes();
+  size_t length = strlen(arena_report);
+#if ARENA_SIZING
+  const tflite::RecordingMicroAllocator& allocator = a->interpreter->GetMicroAllocator();
+  const tflite::RecordingSingleArenaBufferAllocator* arena = allocator.GetSimpleMemoryAllocator();
+  MicroPrintf("%s model arena: %u bytes used, persistent (tail) %u, non persistent (head) %u, smallest arena %u",
+              a->name, (unsigned)used, (unsigned)arena->GetPersistentUsedBytes(),
+              (unsigned)arena->GetNonPersistentUsedBytes(), (unsigned)a->arena_minimum);
+  allocator.PrintAllocations();
+  if (a->arena_minimum > (size_t)kTensorArenaSize) {
+    MicroPrintf("kTensorArenaSize of %d bytes is too small, set it to %u", kTensorArenaSize, (unsigned)a->arena_minimum);
+  } else if (a->arena_minimum + ARENA_SLACK_MAX < (size_t)kTensorArenaSize) {
+    MicroPrintf("kTensorArenaSize oversized by %u bytes, set it to %u",
+                (unsigned)(kTensorArenaSize - a->arena_minimum), (unsigned)a->arena_minimum);
+  }
+  snprintf(&arena_report[length - 1], sizeof(arena_report) - length + 1,
+           "%s\"%s\":{\"arena\":%u,\"used\":%u,\"persistent\":%u,\"non_persistent\":%u,\"minimum\":%u}}",
+           (length > 2) ? "," : "", a->name, (unsigned)a->arena_size, (unsigned)used,
+           (unsigned)arena->GetPersistentUsedBytes(), (unsigned)arena->GetNonPersistentUsedBytes(),
+           (unsigned)a->arena_minimum);
+#else
+  MicroPrintf("%s model arena: %u of %u bytes used", a->name, (unsigned)used, (unsigned)a->arena_size);
+  snprintf(&arena_report[length - 1], sizeof(arena_report) - length + 1,
+           "%s\"%s\":{\"arena\":%u,\"used\":%u,\"free\":%u}}",
+           (length > 2) ? "," : "", a->name, (unsigned)a->arena_size, (unsigned)used,
+           (unsigned)(a->arena_size - used));
+#endif
+}
+
+#if ARENA_SIZING
+// Smallest arena the plain interpreter allocates the model in, by bisection in arena.
+// arena_used_bytes() is only a lower bound: the memory planner also needs temporary buffers
+// while AllocateTensors() runs. Every failed try prints its allocation error.
+size_t MinimumArena(const unsigned char* data, uint8_t* arena, size_t arena_size) {
+  alignas(tflite::MicroInterpreter) static uint8_t buffer[sizeof(tflite::MicroInterpreter)];
+  const tflite::Model* model = tflite::GetModel(data);
+  size_t low = 0;
+  size_t high = arena_size;
+  for (size_t size = arena_size; low < high; size = (low + high) / 2) {
+    tflite::MicroInterpreter* interpreter =
+        new (buffer) tflite::MicroInterpreter(model, resolver, arena, size);
+    if (interpreter->AllocateTensors() == kTfLiteOk) {
+      if (low == 0) {
+        low = interpreter->arena_used_bytes();
+      }
+      high = size;
+    } else if (size == arena_size) {
+      high = 0;
+    } else {
+      low = size + 1;
+    }
+    interpreter->~MicroInterpreter();
+  }
+  return high;
+}
+#endif
+
+bool SetupModel(Autoencoder* a, const unsigned char* data, uint8_t* arena, int arena_size) {
+  a->model = tflite::GetModel(data);
+  if (a->model->version() != TFLITE_SCHEMA_VERSION) {
     MicroPrintf("Model provided is schema version %d not equal to supported "
-                "version %d.", model->version(), TFLITE_SCHEMA_VERSION);
+                "version %d.", a->model->version(), TFLITE_SCHEMA_VERSION);
+    return false;
+  }
+
+  // Build an interpreter to run the model with. The allocator and the memory planner are placed
+  // in the persistent tail of the arena, they are part of the measured size.
+  a->arena_size = arena_size;
+  a->interpreter = new (a->interpreter_buffer) Interpreter(
+      a->model, resolver, arena, arena_size, nullptr, a->profiler);
+
+  // Allocate memory from the tensor_arena for the model's tensors.
+  TfLiteStatus allocate_status = a->interpreter->AllocateTensors();
+  if (allocate_status != kTfLiteOk) {
+    MicroPrintf("AllocateTensors() failed for the %s model, arena of %d bytes too small "
+                "(build with ARENA_SIZING to measure it)", a->name, arena_size);
+    send_to_oled("ARENA ERROR",true);
+    return false;
+  }
+  ReportArena(a);
+
+  // Obtain pointers to the model's input and output tensors.
+  a->input = a->interpreter->input(0);
+  a->output = a->interpreter->output(0);
+  a->input_count = a->input->dims->data[a->input->dims->size - 1];
+  a->batch = (a->input->dims->size > 1) ? a->input->dims->data[0] : 1;
+  if ((a->batch < 1) || (a->batch > INFERENCE_BATCH_MAX)) {
+    MicroPrintf("The %s model has a batch of %d, at most %d", a->name, a->batch, INFERENCE_BATCH_MAX);
+    return false;
+  }
+  if ((a->input_count != AXIS) && (a->input_count != (int)(AXIS * FEATURES_PER_AXIS))
+      && (a->input_count != AXIS * SPECTRUM_BANDS) && (a->input_count != (int)MAX_INPUTS)) {
+    MicroPrintf("Model takes %d inputs, expected %d, %d, %d or %d", a->input_count, AXIS,
+                (int)(AXIS * FEATURES_PER_AXIS), AXIS * SPECTRUM_BANDS, (int)MAX_INPUTS);
+    return false;
+  }
+  if ((a->input->type != a->output->type)
+      || ((a->input->type != kTfLiteFloat32) && (a->input->type != kTfLiteInt8))) {
+    MicroPrintf("The %s model must take and give float32 or int8", a->name);
+    return false;
+  }
+  MicroPrintf("%s model: %d x %d inputs, %s I/O", a->name, a->batch,
+              a->input_count, TfLiteTypeGetName(a->input->type));
+  return true;
+}
+
+// Run one model on rows of input_data, output_data gets the dequantized reconstructions.
+// The rows of the batch left empty are filled with the last row and their output is ignored.
+// Print and publish the per-op window of a model every PROFILE_PERIOD invokes.
+void ReportProfile(Autoencoder* a) {
+#if OP_PROFILING
+  if (a->profiler->invokes() >= PROFILE_PERIOD) {
+    if (a->profiler->Report(profile_report, sizeof(profile_report)) > 0) {
+      mqtt_publish(PROFILE_TOPIC, profile_report, 0, false);
+    } else {
+      MicroPrintf("%s model profile does not fit in %u bytes", a->name, (unsigned)sizeof(profile_report));
+    }
+  }
+#endif
+}
+
+bool RunModel(Autoencoder* a, const float* input_data, int rows, float* output_data) {
+  const int values = rows * a->input_count;
+  const int batch_values = a->batch * a->input_count;
+
+  // The dense engine reads input_data directly, one layer per profiler node.
+  if (a->dense) {
+    int64_t start = esp_timer_get_time();
+    for (int row = 0; row < rows; row++) {
+      if (a->profiler != nullptr) {
+        a->profiler->BeginInvoke();
+        dense::kModel.Invoke(&input_data[row * a->input_count], &output_data[row * a->input_count], a->profiler);
+      } else {
+        dense::kModel.Invoke(&input_data[row * a->input_count], &output_data[row * a->input_count]);
+      }
+    }
+    a->latency_sum_us += esp_timer_get_time() - start;
+    ReportProfile(a);
+    return true;
+  }
+
+  if (a->input->type == kTfLiteInt8) {
+    const float scale = a->input->params.scale;
+    const int32_t zero_point = a->input->params.zero_point;
+    for (int n = 0; n < values; n++) {
+      int32_t q = (int32_t)lroundf(input_data[n] / scale) + zero_point;
+      a->input->data.int8[n] = (int8_t)(q < -128 ? -128 : (q > 127 ? 127 : q));
+    }
+    for (int n = values; n < batch_values; n++) {
+      a->input->data.int8[n] = a->input->data.int8[n - a->input_count];
+    }
+  } else {
+    memcpy(a->input->data.f, input_data, values * sizeof(float));
+    for (int n = values; n < batch_values; n++) {
+      a->input->data.f[n] = a->input->data.f[n - a->input_count];
+    }
+  }
+
+  if (a->profiler != nullptr) {
+    a->profiler->BeginInvoke();
+  }
+  int64_t start = esp_timer_get_time();
+  TfLiteStatus invoke_status = a->interpreter->Invoke();
+  a->latency_sum_us += esp_timer_get_time() - start;
+  if (invoke_status != kTfLiteOk) {
+    MicroPrintf("Invoke failed (%s model)", a->name);
+    return false;
+  }
+  ReportProfile(a);
+
+  if (a->output->type == kTfLiteInt8) {
+    const float scale = a->output->params.scale;
+    const int32_t zero_point = a->output->params.zero_point;
+    for (int n = 0; n < values; n++) {
+      output_data[n] = (a->output->data.int8[n] - zero_point) * scale;
+    }
+  } else {
+    memcpy(output_data, a->output->data.f, values * sizeof(float));
+  }
+  return true;
+}
+
+// Min-max scaling of the model inputs as an affine map, (x - min) / (max - min) = x * scale + offset.
+// Only the skew model has its training range in constants.cc, the others take the features as is.
+float input_scale[MAX_INPUTS];
+float input_offset[MAX_INPUTS];
+
+void SetupScaling(int input_count) {
+  for (int n = 0; n < input_count; n++) {
+    input_scale[n] = 1.0f;
+    input_offset[n] = 0.0f;
+  }
+  if (input_count == AXIS) {
+    const float min[AXIS] = {x_skew_min, y_skew_min, z_skew_min};
+    const float max[AXIS] = {x_skew_max, y_skew_max, z_skew_max};
+    for (int axis = 0; axis < AXIS; axis++) {
+      input_scale[axis] = 1.0f / (max[axis] - min[axis]);
+      input_offset[axis] = -min[axis] * input_scale[axis];
+    }
+  }
+}
+
+#if DENSE_ENGINE
+// Switch the float model to the dense engine when model_dense.h was generated from the linked
+// g_model and gives the same outputs, and print the latency, flash and RAM of both paths.
+void SetupDense(Autoencoder* a) {
+  if ((g_model_len != dense::kSourceModelLength)
+      || (dense::ModelHash(g_model, g_model_len) != dense::kSourceModelHash)) {
+    MicroPrintf("model_dense.h is not generated from this model, rerun tools/dense_codegen.py");
+    return;
+  }
+  if ((a->input_count != dense::Model::kInputs) || (dense::Model::kOutputs != a->input_count)) {
+    MicroPrintf("Dense model takes %d inputs, the %s model %d", dense::Model::kInputs, a->name, a->input_count);
     return;
   }
 
-  // Pull in only the operation implementations we need.
-  static tflite::MicroMutableOpResolver<2> resolver;
-  if (resolver.AddFullyConnected() != kTfLiteOk) {
+  float input_data[MAX_INPUTS];
+  float interpreter_output[MAX_INPUTS];
+  float dense_output[MAX_INPUTS];
+  float max_diff = 0.0f;
+  uint32_t interpreter_cycles = 0;
+  uint32_t dense_cycles = 0;
+  for (int run = 0; run < DENSE_BENCH_RUNS; run++) {
+    // Inputs spread over the range of the features, skewness around 0.
+    for (int n = 0; n < a->input_count; n++) {
+      input_data[n] = (float)((run * 7 + n * 13) % 41 - 20) / 5.0f;
+    }
+    uint32_t start = esp_cpu_get_cycle_count();
+    if (!RunModel(a, input_data, 1, interpreter_output)) {
+      return;
+    }
+    uint32_t middle = esp_cpu_get_cycle_count();
+    dense::kModel.Invoke(input_data, dense_output);
+    uint32_t end = esp_cpu_get_cycle_count();
+    interpreter_cycles += middle - start;
+    dense_cycles += end - middle;
+    for (int n = 0; n < a->input_count; n++) {
+      float diff = fabs(interpreter_output[n] - dense_output[n]);
+      if (diff > max_diff) {
+        max_diff = diff;
+      }
+    }
+  }
+  a->latency_sum_us = 0;
+
+  MicroPrintf("Dense engine vs interpreter over %d runs, max output diff %f", DENSE_BENCH_RUNS, max_diff);
+  MicroPrintf("  latency: dense %u us, interpreter %u us",
+              (unsigned)(dense_cycles / DENSE_BENCH_RUNS / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ),
+              (unsigned)(interpreter_cycles / DENSE_BENCH_RUNS / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ));
+  MicroPrintf("  flash: dense %u B, interpreter %u B of flatbuffer plus the TFLM kernels",
+              (unsigned)sizeof(dense::kModel), (unsigned)g_model_len);
+  MicroPrintf("  RAM: dense none (stack only), interpreter %u B of arena + %u B of interpreter",
+              (unsigned)a->interpreter->arena_used_bytes(), (unsigned)sizeof(Interpreter));
+  if (max_diff > DENSE_TOLERANCE) {
+    MicroPrintf("Dense engine disagrees with the interpreter, kept the interpreter");
     return;
   }
+  a->dense = true;
+}
+#endif
+
+}  // namespace
 
-  if (resolver.AddLogistic() != kTfLiteOk) {
+// The name of this function is important for Arduino compatibility.
+void setup() {
+  // Pull in only the operation implementations we need.
+  if ((resolver.AddFullyConnected() != kTfLiteOk) || (resolver.AddLogistic() != kTfLiteOk)
+      || (resolver.AddQuantize() != kTfLiteOk) || (resolver.AddDequantize() != kTfLiteOk)) {
     return;
   }
 
-  // Build an interpreter to run the model with.
-  static tflite::MicroInterpreter static_interpreter(
-      model, resolver, tensor_arena, kTensorArenaSize);
-  interpreter = &static_interpreter;
+#if OP_PROFILING
+  float_model.profiler = &float_profiler;
+#endif
 
-  // Allocate memory from the tensor_arena for the model's tensors.
-  TfLiteStatus allocate_status = interpreter->AllocateTensors();
-  if (allocate_status != kTfLiteOk) {
-    MicroPrintf("AllocateTensors() failed");
+#if ARENA_SIZING
+  uint8_t* float_arena = sizing_arena;
+  int float_arena_size = ARENA_SIZING_SIZE;
+  float_model.arena_minimum = MinimumArena(g_model, sizing_arena, ARENA_SIZING_SIZE);
+#else
+  uint8_t* float_arena = tensor_arena;
+  int float_arena_size = kTensorArenaSize;
+#endif
+  if (SetupModel(&float_model, g_model, float_arena, float_arena_size)) {
+    active = &float_model;
+#if DENSE_ENGINE
+    SetupDense(&float_model);
+#endif
+  }
+
+  // The learned threshold belongs to the model it was learned on.
+  if (active != nullptr) {
+    SetupScaling(active->input_count);
+    anomaly_threshold_init(dense::ModelHash(g_model, g_model_len), threshold);
+  }
+}
+
+/*
+ * Model input from a feature vector, picked by the input size of the model.
+ * The current autoencoder is trained on the skew registers of the slave (scaled with their training
+ * range from constants.cc), it gets those, not the skewness of the window.
+ * Bigger models get the window statistics, the band energies, or both, axis after axis.
+*/
+static void features_to_input(const vibration_vector_t* v, int input_count, float* input_data) {
+  if (input_count == AXIS) {
+    for (int axis = 0; axis < AXIS; axis++) {
+      input_data[axis] = v->register_skew[axis];
+    }
     return;
   }
+  bool stats = (input_count != AXIS * SPECTRUM_BANDS);
+  bool bands = (input_count != (int)(AXIS * FEATURES_PER_AXIS));
+  for (int axis = 0; axis < AXIS; axis++) {
+    if (stats) {
+      memcpy(input_data, &v->features.axis[axis], sizeof(axis_features_t));
+      input_data += FEATURES_PER_AXIS;
+    }
+    if (bands) {
+      memcpy(input_data, v->spectrum.band[axis], sizeof(v->spectrum.band[axis]));
+      input_data += SPECTRUM_BANDS;
+    }
+  }
+}
 
-  // Obtain pointers to the model's input and output tensors.
-  input = interpreter->input(0);
-  output = interpreter->output(0);
+const char* model_arena_report(void) {
+  return arena_report;
 }
 
+//Print one feature vector.
+static void print_vector(const vibration_vector_t* vector) {
+  const vibration_features_t* features = &vector->features;
+  printf("\nFeature vector %" PRIu32 " (burst %" PRIu32 ")\n", features->seq, vector->spectrum.seq);
+  for (int axis = 0; axis < AXIS; axis++) {
+    printf("axis %d : rms %f peak %f crest %f skewness %f kurtosis %f, bands", axis,
+           features->axis[axis].rms, features->axis[axis].peak, features->axis[axis].crest,
+           features->axis[axis].skewness, features->axis[axis].kurtosis);
+    for (int h = 0; h < SPECTRUM_BANDS; h++) {
+      printf(" %.1f", vector->spectrum.band[axis][h]);
+    }
+    printf("\n");
+  }
+}
+
+/*
+ * Batched inference: the vectors are accumulated up to the batch of the model (capped at
+ * INFERENCE_BATCH) and go through one Invoke(), each row gets its own reconstruction error.
+ * A partial batch runs when no vector came for BATCH_FLUSH_MS, so a slow burst rate does not hold
+ * the decision back.
+*/
 int i = 0;
 // The name of this function is important for Arduino compatibility.
 void loop() {
-  float input_data[AXIS];
-  float output_data[AXIS];
+  static float input_data[INFERENCE_BATCH_MAX * MAX_INPUTS];
+  static float output_data[INFERENCE_BATCH_MAX * MAX_INPUTS];
+  float mae[INFERENCE_BATCH_MAX];
   bool result;
-  if(xQueueReceive(skew_queue,&skew,portMAX_DELAY) == pdPASS){
-    //Copy Normalized data to the input buffer/tensor
-    input_data[0] = skew.x;
-    input_data[1] = skew.y;
-    input_data[2] = skew.z;
+  if(xQueueReceive(features_queue,&vectors[0],portMAX_DELAY) == pdPASS){
+    if (active == nullptr) {
+      return;
+    }
+    int batch = (active->batch < INFERENCE_BATCH) ? active->batch : INFERENCE_BATCH;
+    int rows = 1;
+    while ((rows < batch)
+           && (xQueueReceive(features_queue,&vectors[rows],pdMS_TO_TICKS(BATCH_FLUSH_MS)) == pdPASS)) {
+      rows++;
+    }
 
-    for (int axis = 0; axis < AXIS; axis++) {
-      input->data.f[axis] = input_data[axis];
+    //Copy the feature vectors to the input buffer, one row each, then normalize the whole batch
+    for (int row = 0; row < rows; row++) {
+      features_to_input(&vectors[row], active->input_count, &input_data[row * active->input_count]);
+      print_vector(&vectors[row]);
     }
-    
-    printf("\ninput 1 : %f",input_data[0]);
-    printf("input 2 : %f",input_data[1]);
-    printf("input 3 : %f\n",input_data[2]);
+    scale_rows_f32(input_data, input_data, rows, active->input_count, input_scale, input_offset);
 
     // Run inference, and report any error
-    TfLiteStatus invoke_status = interpreter->Invoke();
-    if (invoke_status != kTfLiteOk) {
-     MicroPrintf("Invoke failed");
+    if (!RunModel(active, input_data, rows, output_data)) {
       return;
     }
     
-    // Read predicted y value from output buffer (tensor)
-    for (int axis = 0; axis < AXIS; axis++) {
-      output_data[axis] = output->data.f[axis];
-    }
-    
-    printf("\noutput 1 : %f",output_data[0]);
-    printf("output 2 : %f",output_data[1]);
-    printf("output 3 : %f\n",output_data[2]);
-    //compute Mean Absolute Error (MAE)
-    float mae =0.0;
-    for (int i = 0; i < AXIS; i++) {
-      mae += fabs(input_data[i] - output_data[i]);
+    //compute Mean Absolute Error (MAE) of every row, the alarm goes through the per-pump threshold
+    result = false;
+    mae_rows_f32(input_data, output_data, rows, active->input_count, mae);
+    for (int row = 0; row < rows; row++) {
+      if (anomaly_threshold_update(mae[row])) {
+        result = true;
+      }
+      printf("MAE of vector %" PRIu32 " : %f, threshold %f%s (%s model)\n", vectors[row].features.seq, mae[row],
+             anomaly_threshold_get(), anomaly_threshold_learning() ? " learning" : "", active->name);
     }
-    mae = mae/AXIS;
-
-    printf("MAE of the resulted data : %f",mae);
 
-    if (mae > threshold) {
-      result = true;
-      
-    }
       /* 
     if ((i==4) || (i==6)){
       result = false;
     }
       */
-    xQueueSend(autoencoder,(void *)&result,portMAX_DELAY);
+    xQueueOverwrite(autoencoder,(void *)&result);   //The sender peeks the latest result.
     i++;
   }
 }
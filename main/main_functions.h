@@ -16,15 +16,35 @@ limitations under the License.
 #ifndef TENSORFLOW_LITE_MICRO_EXAMPLES_HELLO_WORLD_MAIN_FUNCTIONS_H_
 #define TENSORFLOW_LITE_MICRO_EXAMPLES_HELLO_WORLD_MAIN_FUNCTIONS_H_
 
+#include "vibration_features.h"
+#include "vibration_spectrum.h"
+
 // Expose a C friendly interface for main functions.
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Feature vectors run through the autoencoder in one Invoke(). The model must be
+// exported with a batch dimension of at least this for it to take effect.
+#define INFERENCE_BATCH       4
+#define INFERENCE_BATCH_MAX   8     // Largest batch of a model, also the depth of the vector queue.
+
+// Everything the autoencoder can take from one hop of the MPU waveform: the
+// window statistics and the band energies of the burst that completed the hop,
+// and the skew registers polled next to it.
+typedef struct {
+  vibration_features_t features;
+  vibration_spectrum_t spectrum;
+  float register_skew[VIBRATION_AXES];  // X/Y/Z skew registers of the slave when the burst was read.
+} vibration_vector_t;
+
 // Initializes all data needed for the example. The name is important, and needs
 // to be setup() for Arduino compatibility.
 void setup();
 
+// Arena use of the model measured by setup(), as a JSON object keyed by model.
+const char* model_arena_report(void);
+
 // Runs one iteration of data gathering and inference. This should be called
 // repeatedly from the application code. The name needs to be loop() for Arduino
 // compatibility.
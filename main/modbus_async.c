@@ -0,0 +1,164 @@
+#include "modbus_async.h"
+#include <string.h>
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+
+#define TAG "MODBUS ASYNC"
+
+#define MODBUS_ASYNC_TASK_PRIO      2           //Above the producers, so the bus never waits for them.
+#define MODBUS_ASYNC_TASK_STACK     4096
+#define MODBUS_ASYNC_TASK_CORE      1
+
+#define MB_FC_READ_COILS                0x01
+#define MB_FC_READ_DISCRETE_INPUTS      0x02
+#define MB_FC_WRITE_SINGLE_COIL         0x05
+#define MB_FC_WRITE_REGISTER            0x06
+#define MB_FC_WRITE_MULTIPLE_COILS      0x0F
+#define MB_FC_WRITE_MULTIPLE_REGISTERS  0x10
+
+typedef struct{
+    mb_param_request_t request;
+    uint32_t timeout_ms;
+    modbus_async_cb_t cb;
+    void* arg;
+    uint16_t data[MODBUS_ASYNC_MAX_REGS];
+}modbus_async_slot_t;
+
+/*
+ * Slots go round between two queues of indexes: the free ones, and the ones to send.
+ * Both are filled and drained in FIFO order, so requests reach the bus in submission order.
+*/
+static modbus_async_slot_t slots[MODBUS_ASYNC_DEPTH];
+static QueueHandle_t free_slots = NULL;
+static QueueHandle_t pending_slots = NULL;
+
+//Tasks on the poll path, their heap allocations are counted.
+#define MODBUS_ASYNC_WATCHED    3
+static TaskHandle_t watched_tasks[MODBUS_ASYNC_WATCHED];
+static uint32_t alloc_count = 0;
+
+#if CONFIG_HEAP_USE_HOOKS
+//Called by the heap on every allocation, from IRAM, it must not allocate itself.
+//Both cores allocate, the count is an atomic add.
+void IRAM_ATTR esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps){
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    for(int i = 0; i < MODBUS_ASYNC_WATCHED; i++){
+        if((watched_tasks[i] != NULL) && (watched_tasks[i] == task)){
+            __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+}
+#endif
+
+static bool is_write(uint8_t command){
+    return (command == MB_FC_WRITE_SINGLE_COIL) || (command == MB_FC_WRITE_REGISTER)
+        || (command == MB_FC_WRITE_MULTIPLE_COILS) || (command == MB_FC_WRITE_MULTIPLE_REGISTERS);
+}
+
+static bool is_bits(uint8_t command){
+    return (command == MB_FC_READ_COILS) || (command == MB_FC_READ_DISCRETE_INPUTS)
+        || (command == MB_FC_WRITE_MULTIPLE_COILS);
+}
+
+//Bytes of data carried by a request.
+static size_t request_bytes(const mb_param_request_t* request){
+    if((request->command == MB_FC_WRITE_SINGLE_COIL) || (request->command == MB_FC_WRITE_REGISTER)){
+        return sizeof(uint16_t);
+    }
+    if(is_bits(request->command)){
+        return (request->reg_size + 7) >> 3;
+    }
+    return request->reg_size << 1;
+}
+
+static void modbus_async_task(void* parameter){
+    uint8_t index;
+    uint32_t timeout_ms = CONFIG_FMB_MASTER_TIMEOUT_MS_RESPOND;
+    while(1){
+        xQueueReceive(pending_slots, &index, portMAX_DELAY);
+        modbus_async_slot_t* slot = &slots[index];
+        uint32_t slot_timeout = slot->timeout_ms ? slot->timeout_ms : CONFIG_FMB_MASTER_TIMEOUT_MS_RESPOND;
+        if(slot_timeout != timeout_ms){
+            if(mbc_master_set_response_timeout(slot_timeout) == ESP_OK){
+                timeout_ms = slot_timeout;
+            }
+        }
+        //The stack keeps the T3.5 gap, the next frame goes out as soon as this one is answered.
+        int64_t start = esp_timer_get_time();
+        esp_err_t err = mbc_master_send_request(&slot->request, (void*)slot->data);
+        uint32_t latency_us = (uint32_t)(esp_timer_get_time() - start);
+        if(slot->cb != NULL){
+            slot->cb(err, &slot->request, slot->data, latency_us, slot->arg);
+        }
+        xQueueSend(free_slots, &index, portMAX_DELAY);
+    }
+}
+
+esp_err_t modbus_async_init(void){
+    if(pending_slots != NULL){
+        return ESP_OK;
+    }
+    free_slots = xQueueCreate(MODBUS_ASYNC_DEPTH, sizeof(uint8_t));
+    pending_slots = xQueueCreate(MODBUS_ASYNC_DEPTH, sizeof(uint8_t));
+    if((free_slots == NULL) || (pending_slots == NULL)){
+        ESP_LOGE(TAG, "Queue creation failed");
+        return ESP_ERR_NO_MEM;
+    }
+    for(uint8_t i = 0; i < MODBUS_ASYNC_DEPTH; i++){
+        xQueueSend(free_slots, &i, 0);
+    }
+    if(xTaskCreatePinnedToCore(modbus_async_task, "mb_async", MODBUS_ASYNC_TASK_STACK, NULL,
+                               MODBUS_ASYNC_TASK_PRIO, &watched_tasks[0], MODBUS_ASYNC_TASK_CORE) != pdPASS){
+        ESP_LOGE(TAG, "Task creation failed");
+        return ESP_ERR_NO_MEM;
+    }
+    //Tasks of the esp-modbus master, created by mbc_master_setup()/mbc_master_start().
+    watched_tasks[1] = xTaskGetHandle("modbus_matask");
+    watched_tasks[2] = xTaskGetHandle("uart_queue_task");
+#if !CONFIG_HEAP_USE_HOOKS
+    ESP_LOGW(TAG, "CONFIG_HEAP_USE_HOOKS is off, allocations of the poll are not counted");
+#endif
+    return ESP_OK;
+}
+
+esp_err_t modbus_async_submit(const mb_param_request_t* request, const void* data, uint32_t timeout_ms,
+                              modbus_async_cb_t cb, void* arg, TickType_t wait){
+    if((request == NULL) || (request_bytes(request) > sizeof(slots[0].data))
+            || (is_write(request->command) && (data == NULL))){
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(pending_slots == NULL){
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint8_t index;
+    if(xQueueReceive(free_slots, &index, wait) != pdTRUE){
+        return ESP_ERR_TIMEOUT;
+    }
+    modbus_async_slot_t* slot = &slots[index];
+    slot->request = *request;
+    slot->timeout_ms = timeout_ms;
+    slot->cb = cb;
+    slot->arg = arg;
+    if(is_write(request->command)){
+        memcpy(slot->data, data, request_bytes(request));
+    }
+    xQueueSend(pending_slots, &index, portMAX_DELAY);
+    return ESP_OK;
+}
+
+uint32_t modbus_async_pending(void){
+    if(free_slots == NULL){
+        return 0;
+    }
+    return MODBUS_ASYNC_DEPTH - uxQueueMessagesWaiting(free_slots);
+}
+
+uint32_t modbus_async_alloc_count(void){
+    return __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,51 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _MODBUS_ASYNC_H_
+#define _MODBUS_ASYNC_H_
+
+#include <mbcontroller.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+
+#define MODBUS_ASYNC_DEPTH      8           //Requests queued or in flight at the same time.
+#define MODBUS_ASYNC_MAX_REGS   125         //Largest request (FC03/FC04 register limit).
+
+/*
+ * Completion callback, called from the Modbus request task once the transaction is over.
+ * data holds the registers (or bits) read, or the ones written, and is only valid during the call.
+ * latency_us is the time the request spent on the bus, queueing excluded.
+ * Keep it short: the next request is sent as soon as it returns.
+*/
+typedef void (*modbus_async_cb_t)(esp_err_t err, const mb_param_request_t* request, const void* data,
+                                  uint32_t latency_us, void* arg);
+
+//Start the task that sends the queued requests back to back, after mbc_master_start().
+esp_err_t modbus_async_init(void);
+
+/*
+ * Queue a request to mbc_master_send_request() and return without waiting for the bus.
+ * For writes, the reg_size registers (or bits) of data are copied, data can be reused right after the call.
+ * timeout_ms is the respond timeout of this request, 0 for CONFIG_FMB_MASTER_TIMEOUT_MS_RESPOND.
+ * wait is how long to block when the pipeline is full, 0 returns ESP_ERR_TIMEOUT at once.
+*/
+esp_err_t modbus_async_submit(const mb_param_request_t* request, const void* data, uint32_t timeout_ms,
+                              modbus_async_cb_t cb, void* arg, TickType_t wait);
+
+//Number of requests queued or in flight.
+uint32_t modbus_async_pending(void);
+
+/*
+ * Heap allocations made by the tasks the poll goes through: the request task, the Modbus master
+ * task and its UART task. Counted from the heap hook (CONFIG_HEAP_USE_HOOKS), it should not move
+ * once polling runs. Valid after modbus_async_init(). CONFIG_HEAP_USE_HOOKS is only on for this count.
+*/
+uint32_t modbus_async_alloc_count(void);
+
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
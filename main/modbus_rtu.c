@@ -1,8 +1,3 @@
-
-
-#ifndef _MODBUS_RTU_H
-#define _MODBUS_RTU_H
-
 #include "modbus_rtu.h"
 #include <mbcontroller.h>
 #include "driver/uart.h"
@@ -10,10 +5,14 @@
 #include <inttypes.h>
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
 #include "connect.h"
+#include "nvs.h"
+#include "modbus_async.h"
+#include "modbus_tcp_slave.h"
 
 
-#define samples 128
 #define TAG "MODBUS RTU"
 
 #define INPUT_OFFSET(field) ((uint16_t)(offsetof(input_reg_params_t, field) + 1))
@@ -32,7 +31,7 @@ typedef struct {
 }messages;
 
 enum{
-    MB_SLAVE_ADD1 = 1,              //We have one slave.
+    MB_SLAVE_ADD1 = 1,              //Address of the descriptor template, the local pump.
     MB_SLAVE_COUNT
 };
 
@@ -43,7 +42,8 @@ enum{
     CID_INPUT_CURRENT_DATA,                 //Floating point.
     CID_INPUT_FLOW_RATE_DATA,               //Floating point.
     CID_INPUT_TOTAL_FLOW_DATA,              //Floating point.
-    CID_COIL_PUMP                           //Pump ON or OFF.
+    CID_COIL_PUMP,                          //Pump ON or OFF.
+    CID_COUNT
 };
 
 typedef struct{
@@ -60,8 +60,9 @@ typedef struct{
 }coil_reg_params_t;
 
 
-coil_reg_params_t coil_reg_params= {0};
-input_reg_params_t input_reg_params = {0};
+//One copy of the parameters per polled slave, index 0 is the slave of the descriptor template.
+coil_reg_params_t coil_reg_params[MB_SLAVE_MAX] = {0};
+input_reg_params_t input_reg_params[MB_SLAVE_MAX] = {0};
 
 const mb_parameter_descriptor_t device_parameters[] = {
     //X-axis input data (128 samples).
@@ -172,7 +173,11 @@ const mb_parameter_descriptor_t device_parameters[] = {
 
 const uint16_t num_device_parameters = (sizeof(device_parameters)/sizeof(device_parameters[0]));
 
-void* master_get_param_data(const mb_parameter_descriptor_t* param_descriptor)
+_Static_assert(sizeof(device_parameters)/sizeof(device_parameters[0]) == CID_COUNT,
+               "one descriptor per CID");
+
+
+static void* slave_param_data(uint8_t slave, const mb_parameter_descriptor_t* param_descriptor)
 {
     assert(param_descriptor != NULL);
     void* instance_ptr = NULL;
@@ -180,10 +185,10 @@ void* master_get_param_data(const mb_parameter_descriptor_t* param_descriptor)
        switch(param_descriptor->mb_param_type)
        {
            case MB_PARAM_INPUT:
-               instance_ptr = ((void*)&input_reg_params + param_descriptor->param_offset - 1);
+               instance_ptr = ((void*)&input_reg_params[slave] + param_descriptor->param_offset - 1);
                break;
             case MB_PARAM_COIL:
-               instance_ptr = ((void*)&coil_reg_params + param_descriptor->param_offset - 1);
+               instance_ptr = ((void*)&coil_reg_params[slave] + param_descriptor->param_offset - 1);
                break;
            default:
                instance_ptr = NULL;
@@ -196,7 +201,345 @@ void* master_get_param_data(const mb_parameter_descriptor_t* param_descriptor)
     return instance_ptr;
 }
 
+void* master_get_param_data(const mb_parameter_descriptor_t* param_descriptor)
+{
+    return slave_param_data(0, param_descriptor);
+}
+
+/*
+ * Snapshot store.
+ * The parameter structures are written by the Modbus request task only, and read by any task with
+ * get_modbus_point()/get_modbus_points(). Each slave has a sequence counter used as a seqlock:
+ * it is odd while a span is decoded, a reader copies the points it wants and starts over when the
+ * counter was odd or has moved meanwhile. The request task never waits for a reader.
+*/
+#define MB_SNAPSHOT_SPINS           8           //Retries before a reader sleeps one tick to let the writer finish.
+
+typedef struct{
+    uint32_t seq;
+    int64_t timestamp;
+}point_meta_t;
+
+static uint32_t snapshot_seq[MB_SLAVE_MAX];
+static point_meta_t point_meta[MB_SLAVE_MAX][CID_COUNT];
+
+static void snapshot_write_begin(uint8_t slave){
+    __atomic_store_n(&snapshot_seq[slave], snapshot_seq[slave] + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void snapshot_write_end(uint8_t slave){
+    __atomic_store_n(&snapshot_seq[slave], snapshot_seq[slave] + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Slaves polled with the descriptor template.
+ * Every slave gets its own respond timeout, derived from its measured latency, and a slave that
+ * fails is skipped with exponential backoff, so a dead unit costs one short probe per backoff period
+ * instead of a full timeout on every poll.
+*/
+#define MB_SLAVE_TIMEOUT_MIN_MS     100         //Lowest respond timeout of a healthy slave.
+#define MB_SLAVE_TIMEOUT_LATENCY    4           //Respond timeout = 4 x average latency, at least the minimum.
+#define MB_SLAVE_PROBE_TIMEOUT_MS   200         //Respond timeout when retrying an offline slave.
+#define MB_SLAVE_BACKOFF_MIN_MS     500
+#define MB_SLAVE_BACKOFF_MAX_MS     60000
+
+static uint8_t num_slaves = 1;
+static portMUX_TYPE slaves_lock = portMUX_INITIALIZER_UNLOCKED;     //Health is updated by the request task.
+static modbus_slave_health_t slaves[MB_SLAVE_MAX] = {
+    { .addr = MB_SLAVE_ADD1, .online = true, .timeout_ms = CONFIG_FMB_MASTER_TIMEOUT_MS_RESPOND }
+};
+
+esp_err_t modbus_set_slaves(const uint8_t* addrs, uint8_t count){
+    if((addrs == NULL) || (count == 0) || (count > MB_SLAVE_MAX)){
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(slaves, 0, sizeof(slaves));
+    for(uint8_t i = 0; i < count; i++){
+        slaves[i].addr = addrs[i];
+        slaves[i].online = true;
+        slaves[i].timeout_ms = CONFIG_FMB_MASTER_TIMEOUT_MS_RESPOND;
+    }
+    num_slaves = count;
+    return ESP_OK;
+}
+
+uint8_t modbus_slave_count(void){
+    return num_slaves;
+}
+
+esp_err_t modbus_get_slave_health(uint8_t slave, modbus_slave_health_t* health){
+    if((slave >= num_slaves) || (health == NULL)){
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&slaves_lock);
+    *health = slaves[slave];
+    portEXIT_CRITICAL(&slaves_lock);
+    return ESP_OK;
+}
+
+//Update the counters of a slave after one request that took latency_us.
+static void slave_account(modbus_slave_health_t* slave, esp_err_t err, uint32_t latency_us){
+    bool was_online = slave->online;
+    portENTER_CRITICAL(&slaves_lock);
+    slave->requests++;
+    if(err == ESP_OK){
+        slave->last_latency_us = latency_us;
+        if(latency_us > slave->max_latency_us){
+            slave->max_latency_us = latency_us;
+        }
+        slave->avg_latency_us = (slave->avg_latency_us == 0) ? latency_us
+                              : slave->avg_latency_us - (slave->avg_latency_us >> 3) + (latency_us >> 3);
+        uint32_t timeout_ms = (slave->avg_latency_us * MB_SLAVE_TIMEOUT_LATENCY) / 1000;
+        if(timeout_ms < MB_SLAVE_TIMEOUT_MIN_MS){
+            timeout_ms = MB_SLAVE_TIMEOUT_MIN_MS;
+        }
+        if(timeout_ms > CONFIG_FMB_MASTER_TIMEOUT_MS_RESPOND){
+            timeout_ms = CONFIG_FMB_MASTER_TIMEOUT_MS_RESPOND;
+        }
+        slave->timeout_ms = timeout_ms;
+        slave->online = true;
+        slave->consecutive_errors = 0;
+        slave->retry_at = 0;
+        portEXIT_CRITICAL(&slaves_lock);
+        if(!was_online){
+            ESP_LOGI(TAG, "Slave %u back online", (unsigned)slave->addr);
+        }
+        return;
+    }
+    slave->errors++;
+    if(err == ESP_ERR_TIMEOUT){
+        slave->timeouts++;
+    }
+    slave->consecutive_errors++;
+    uint32_t shift = slave->consecutive_errors - 1;
+    uint32_t backoff_ms = (shift >= 8) ? MB_SLAVE_BACKOFF_MAX_MS : (MB_SLAVE_BACKOFF_MIN_MS << shift);
+    if(backoff_ms > MB_SLAVE_BACKOFF_MAX_MS){
+        backoff_ms = MB_SLAVE_BACKOFF_MAX_MS;
+    }
+    slave->retry_at = esp_timer_get_time() + (int64_t)backoff_ms * 1000;
+    slave->online = false;
+    portEXIT_CRITICAL(&slaves_lock);
+    if(was_online){
+        ESP_LOGW(TAG, "Slave %u offline, error: %s", (unsigned)slave->addr, esp_err_to_name(err));
+    }
+}
+
+/*
+ * Block read plan.
+ * Descriptors of the same slave and register type that sit on adjacent registers are merged
+ * into one request, so a full poll costs one FC04 for the input registers and one FC01 for the coils
+ * instead of one transaction per CID.
+*/
+#define MB_FC_READ_COILS            0x01
+#define MB_FC_READ_DISCRETE_INPUTS  0x02
+#define MB_FC_READ_HOLDING          0x03
+#define MB_FC_READ_INPUT            0x04
+#define MB_FC_WRITE_MULTIPLE_COILS      0x0F
+#define MB_FC_WRITE_MULTIPLE_REGISTERS  0x10
+
+#define MB_WRITE_MAX_REGS           4           //Largest parameter written (64 bits).
+#define MB_WRITE_QUEUE_WAIT_MS      500         //Longest wait for a free request slot when writing.
+
+static uint32_t init_baudrate = 9600;      //Rate given to modbusRTU_init(), the fallback of the negotiation.
+static uint32_t bus_baudrate = 9600;       //Rate the bus runs at now.
+
+#define MB_BLOCK_MAX                8           //Maximum number of merged requests per poll.
+#define MB_BLOCK_MAX_REGS           125         //FC03/FC04 limit of registers per request.
+#define MB_BLOCK_MAX_BITS           (MB_BLOCK_MAX_REGS * 16)    //FC01/FC02 bits that fit in the same buffer.
+
+typedef struct{
+    uint8_t slave_addr;
+    mb_param_type_t type;
+    uint16_t reg_start;
+    uint16_t reg_size;                  //Registers for FC03/FC04, bits for FC01/FC02.
+    uint16_t first_cid;
+    uint16_t cid_count;
+}modbus_block_t;
+
+static modbus_block_t poll_blocks[MB_BLOCK_MAX];
+static uint16_t num_poll_blocks = 0;
+
+/*
+ * Poll requests go through the asynchronous request queue: every block of every slave is queued
+ * at once and the request task sends them back to back. Only the requests of the first slave are
+ * waited for, the others are decoded by their completion callback while the caller goes on.
+*/
+typedef struct{
+    uint8_t slave;
+    const modbus_block_t* block;
+    uint16_t first_cid;
+    uint16_t last_cid;
+    volatile bool pending;              //Still queued from an earlier poll, not queued again.
+    SemaphoreHandle_t done;             //Given on completion when someone waits for the request.
+    esp_err_t* result;                  //Keeps the first error of the requests waited for.
+}modbus_poll_request_t;
+
+static modbus_poll_request_t poll_requests[MB_SLAVE_MAX][MB_BLOCK_MAX];
+static SemaphoreHandle_t local_done = NULL;     //Given by each completed request the caller waits for.
+static esp_err_t local_result = ESP_OK;         //First error of those requests.
+
+static uint8_t block_command(mb_param_type_t type){
+    switch(type){
+        case MB_PARAM_HOLDING:  return MB_FC_READ_HOLDING;
+        case MB_PARAM_INPUT:    return MB_FC_READ_INPUT;
+        case MB_PARAM_COIL:     return MB_FC_READ_COILS;
+        case MB_PARAM_DISCRETE: return MB_FC_READ_DISCRETE_INPUTS;
+        default:                return 0;
+    }
+}
+
+static bool block_is_bits(mb_param_type_t type){
+    return (type == MB_PARAM_COIL) || (type == MB_PARAM_DISCRETE);
+}
+
+//Group the readable descriptors into as few requests as the register map allows.
+static esp_err_t build_poll_blocks(void){
+    num_poll_blocks = 0;
+    modbus_block_t* block = NULL;
+    for(uint16_t i = 0; i < num_device_parameters; i++){
+        const mb_parameter_descriptor_t* param = &device_parameters[i];
+        if(!(param->access & PAR_PERMS_READ) || (block_command(param->mb_param_type) == 0)){
+            block = NULL;
+            continue;
+        }
+        uint16_t limit = block_is_bits(param->mb_param_type) ? MB_BLOCK_MAX_BITS : MB_BLOCK_MAX_REGS;
+        if((block != NULL)
+                && (block->slave_addr == param->mb_slave_addr)
+                && (block->type == param->mb_param_type)
+                && (block->reg_start + block->reg_size == param->mb_reg_start)
+                && (block->reg_size + param->mb_size <= limit)){
+            block->reg_size += param->mb_size;
+            block->cid_count++;
+            continue;
+        }
+        if(num_poll_blocks >= MB_BLOCK_MAX){
+            ESP_LOGE(TAG, "Too many poll blocks, increase MB_BLOCK_MAX");
+            return ESP_ERR_NO_MEM;
+        }
+        block = &poll_blocks[num_poll_blocks++];
+        block->slave_addr = param->mb_slave_addr;
+        block->type = param->mb_param_type;
+        block->reg_start = param->mb_reg_start;
+        block->reg_size = param->mb_size;
+        block->first_cid = param->cid;
+        block->cid_count = 1;
+    }
+    ESP_LOGI(TAG, "%u CIDs merged into %u poll blocks", (unsigned)num_device_parameters, (unsigned)num_poll_blocks);
+    return ESP_OK;
+}
+
+//Copy one CID out of the registers of a block (read from base_reg) into the parameter structures of a slave.
+static esp_err_t decode_block_param(uint8_t slave, const modbus_block_t* block, const uint16_t* block_buffer,
+                                    uint16_t base_reg, const mb_parameter_descriptor_t* param){
+    void* instance_ptr = slave_param_data(slave, param);
+    if(instance_ptr == NULL){
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint16_t offset = param->mb_reg_start - base_reg;
+    if(!block_is_bits(block->type)){
+        return mbc_master_set_param_data(instance_ptr, (void*)&block_buffer[offset],
+                                         param->param_type, param->param_size);
+    }
+    const uint8_t* bits = (const uint8_t*)block_buffer;
+    uint8_t* dest = (uint8_t*)instance_ptr;
+    memset(dest, 0, param->param_size);
+    for(uint16_t bit = 0; (bit < param->mb_size) && ((bit >> 3) < param->param_size); bit++){
+        uint16_t src_bit = offset + bit;
+        if(bits[src_bit >> 3] & (1 << (src_bit & 7))){
+            dest[bit >> 3] |= (1 << (bit & 7));
+        }
+    }
+    return ESP_OK;
+}
+
+//Completion of one poll request, decodes every CID of the span into the snapshot of the slave.
+static void poll_request_done(esp_err_t err, const mb_param_request_t* request, const void* data,
+                              uint32_t latency_us, void* arg){
+    modbus_poll_request_t* poll = (modbus_poll_request_t*)arg;
+    slave_account(&slaves[poll->slave], err, latency_us);
+    if(err != ESP_OK){
+        printf("Failed to read block at %u (slave %u), error: %s\n",
+               (unsigned)request->reg_start, (unsigned)request->slave_addr, esp_err_to_name(err));
+    }else{
+        int64_t now = esp_timer_get_time();
+        snapshot_write_begin(poll->slave);
+        for(uint16_t cid = poll->first_cid; (err == ESP_OK) && (cid <= poll->last_cid); cid++){
+            err = decode_block_param(poll->slave, poll->block, (const uint16_t*)data, request->reg_start, &device_parameters[cid]);
+            if(err == ESP_OK){
+                point_meta[poll->slave][cid].seq++;
+                point_meta[poll->slave][cid].timestamp = now;
+            }
+        }
+        snapshot_write_end(poll->slave);
+        if(err != ESP_OK){
+            printf("Failed to decode block at %u (slave %u), error: %s\n",
+                   (unsigned)request->reg_start, (unsigned)request->slave_addr, esp_err_to_name(err));
+        }
+    }
+    if(err == ESP_OK){
+        modbus_tcp_slave_update(poll->slave, poll->first_cid, poll->last_cid);
+    }
+    poll->pending = false;
+    if((err != ESP_OK) && (poll->result != NULL) && (*poll->result == ESP_OK)){
+        *poll->result = err;
+    }
+    if(poll->done != NULL){
+        xSemaphoreGive(poll->done);
+    }
+}
+
+/*
+ * Queue the registers of a block from first_cid to last_cid of a slave as one request.
+ * The block addresses of the template are used as they are, only the slave address changes.
+*/
+static esp_err_t submit_block_span(uint8_t slave, uint16_t block_index, uint16_t first_cid, uint16_t last_cid, uint32_t timeout_ms){
+    modbus_poll_request_t* poll = &poll_requests[slave][block_index];
+    if(poll->pending){
+        return ESP_ERR_INVALID_STATE;
+    }
+    const mb_parameter_descriptor_t* first = &device_parameters[first_cid];
+    const mb_parameter_descriptor_t* last = &device_parameters[last_cid];
+    mb_param_request_t request = {
+        .slave_addr = slaves[slave].addr,
+        .command = block_command(poll_blocks[block_index].type),
+        .reg_start = first->mb_reg_start,
+        .reg_size = last->mb_reg_start + last->mb_size - first->mb_reg_start
+    };
+    poll->slave = slave;
+    poll->block = &poll_blocks[block_index];
+    poll->first_cid = first_cid;
+    poll->last_cid = last_cid;
+    poll->pending = true;
+    //Only the first slave is waited for.
+    poll->done = (slave == 0) ? local_done : NULL;
+    poll->result = (slave == 0) ? &local_result : NULL;
+    //Wait for a free slot when the pipeline is full, the bus drains it.
+    esp_err_t err = modbus_async_submit(&request, NULL, timeout_ms, poll_request_done, poll, portMAX_DELAY);
+    if(err != ESP_OK){
+        poll->pending = false;
+    }
+    return err;
+}
+
+/*
+ * Waveform burst.
+ * The slave exposes the MPU samples as int16 input registers right after the scalar block,
+ * X first then Y and Z. The whole 3x128 block is pulled in register-limit-sized chunks.
+*/
+#define WAVEFORM_REG_START          12          //First X-axis sample register on the slave.
+#define WAVEFORM_REG_COUNT          (3 * samples)
+#define WAVEFORM_RING_DEPTH         4
+
+_Static_assert(offsetof(waveform_reg_params_t, input_z) == 2 * samples * sizeof(int16_t),
+               "waveform axes must be contiguous");
+
+static waveform_reg_params_t waveform_ring[WAVEFORM_RING_DEPTH];
+static uint32_t waveform_seq = 0;
+
 esp_err_t modbusRTU_init(uint32_t baudrate){
+    init_baudrate = baudrate;
+    bus_baudrate = baudrate;
     mb_communication_info_t comm = {
             .port = UART_NUM_2,
             .mode = MB_MODE_RTU,
@@ -242,48 +585,401 @@ esp_err_t modbusRTU_init(uint32_t baudrate){
         return err;
     }
     send_to_oled("MB dscptr succ",false);
-    return err;
+    local_done = xSemaphoreCreateCounting(MODBUS_ASYNC_DEPTH + MB_BLOCK_MAX, 0);
+    if(local_done == NULL){
+        return ESP_ERR_NO_MEM;
+    }
+    err = modbus_async_init();
+    if(err != ESP_OK){
+        send_to_oled("MB async err",true);
+        return err;
+    }
+    return build_poll_blocks();
 }
 
-void* read_modbus_data(uint16_t cid_) {
-    esp_err_t err;
-    mb_parameter_descriptor_t* param_descriptor = NULL;
-    uint8_t type = 0;
-    void* temp_data_ptr = NULL;
-    err = mbc_master_get_cid_info(cid_, &param_descriptor);
-    if (err != ESP_OK || param_descriptor == NULL) {
-        printf("Failed to get CID info, error: %s\n", esp_err_to_name(err));
-        return NULL; 
+/*
+ * Queue the due CIDs (all of them when due is NULL) of one slave, merged per block, and return
+ * the number of requests queued. The slave is skipped while it is backing off, and gets a short
+ * probe timeout when it is retried, so the other slaves still get their turn in this poll.
+*/
+static uint16_t submit_slave_due(uint8_t slave, const bool* due){
+    modbus_slave_health_t health;
+    modbus_get_slave_health(slave, &health);
+    uint32_t timeout_ms = health.timeout_ms;
+    if(!health.online){
+        if(esp_timer_get_time() < health.retry_at){
+            return 0;
+        }
+        timeout_ms = MB_SLAVE_PROBE_TIMEOUT_MS;
     }
-    temp_data_ptr = master_get_param_data(param_descriptor);
-    if (temp_data_ptr == NULL) {
-        printf("Failed to get parameter data\n");
-        return NULL;
+    uint16_t submitted = 0;
+    for(uint16_t i = 0; i < num_poll_blocks; i++){
+        const modbus_block_t* block = &poll_blocks[i];
+        int first_cid = -1;
+        int last_cid = -1;
+        for(uint16_t cid = block->first_cid; cid < block->first_cid + block->cid_count; cid++){
+            if((due == NULL) || due[cid]){
+                if(first_cid < 0){
+                    first_cid = cid;
+                }
+                last_cid = cid;
+            }
+        }
+        if(first_cid < 0){
+            continue;
+        }
+        //The registers between two due CIDs are read too, a longer frame is cheaper than another transaction.
+        if(submit_block_span(slave, i, first_cid, last_cid, timeout_ms) == ESP_OK){
+            submitted++;
+        }
+    }
+    return submitted;
+}
+
+//Wait for count requests of the caller, returns the first error among them.
+static esp_err_t wait_local_requests(uint16_t count){
+    while(count--){
+        xSemaphoreTake(local_done, portMAX_DELAY);      //The request task always completes a request.
+    }
+    return local_result;
+}
+
+/*
+ * Poll every slave, the result is the one of the first slave.
+ * The first slave is queued first so it is answered first, the other slaves are still on the bus
+ * when this returns.
+*/
+static void reprobe_absent_slaves(void);
+
+static esp_err_t read_slaves_due(const bool* due){
+    reprobe_absent_slaves();
+    local_result = ESP_OK;
+    uint16_t local_count = submit_slave_due(0, due);
+    bool local_skipped = (local_count == 0) && !slaves[0].online;
+    for(uint8_t slave = 1; slave < num_slaves; slave++){
+        submit_slave_due(slave, due);
+    }
+    esp_err_t err = wait_local_requests(local_count);
+    return local_skipped ? ESP_ERR_TIMEOUT : err;
+}
+
+/*
+ * Baud rate negotiation.
+ * The slaves that answer at the init rate are probed at each faster rate with a burst of reads
+ * of the first poll block, and the fastest rate where every one of them reads cleanly (CRC checked
+ * by the stack) is kept. The rate is stored in NVS with the set of slaves it was found for, so the
+ * next boot tries it first, and does not search again when no faster rate worked for the same slaves.
+ * A slave missing at negotiation is probed again at the init rate every MB_BAUD_REPROBE_MS, and the
+ * bus is negotiated again once it answers.
+*/
+#define MB_BAUD_NVS_NAMESPACE       "modbus"
+#define MB_BAUD_NVS_KEY             "baud"
+#define MB_BAUD_NVS_SLAVES_KEY      "baud_slaves"   //Bit mask of the slaves the stored rate was found for.
+#define MB_BAUD_PROBE_READS         8               //Reads per slave that must all pass.
+#define MB_BAUD_REPROBE_MS          60000
+
+static const uint32_t baud_candidates[] = { 115200, 57600, 38400, 19200 };  //Fastest first.
+
+static bool absent[MB_SLAVE_MAX];               //Did not answer at the init rate at negotiation.
+static int64_t reprobe_at = 0;
+
+//Completion of one probe read.
+static void probe_request_done(esp_err_t err, const mb_param_request_t* request, const void* data,
+                               uint32_t latency_us, void* arg){
+    if((err != ESP_OK) && (local_result == ESP_OK)){
+        local_result = err;
+    }
+    xSemaphoreGive(local_done);
+}
+
+//Up to reads reads of the first poll block from one slave, one at a time, stops at the first failure.
+static bool probe_slave(uint8_t slave, uint16_t reads){
+    const modbus_block_t* block = &poll_blocks[0];
+    mb_param_request_t request = {
+        .slave_addr = slaves[slave].addr,
+        .command = block_command(block->type),
+        .reg_start = block->reg_start,
+        .reg_size = block->reg_size
+    };
+    for(uint16_t i = 0; i < reads; i++){
+        local_result = ESP_OK;
+        if(modbus_async_submit(&request, NULL, MB_SLAVE_PROBE_TIMEOUT_MS, probe_request_done, NULL, portMAX_DELAY) != ESP_OK){
+            return false;
+        }
+        if(wait_local_requests(1) != ESP_OK){
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool set_bus_baudrate(uint32_t baudrate){
+    if(mbc_master_set_baudrate(baudrate) != ESP_OK){
+        return false;
+    }
+    bus_baudrate = baudrate;
+    vTaskDelay(pdMS_TO_TICKS(10));      //Let the slaves see an idle line at the new rate.
+    return true;
+}
+
+//Every slave flagged in present[] passes a probe burst at baudrate.
+static bool probe_baudrate(uint32_t baudrate, const bool* present){
+    if(!set_bus_baudrate(baudrate)){
+        return false;
+    }
+    for(uint8_t slave = 0; slave < num_slaves; slave++){
+        if(present[slave] && !probe_slave(slave, MB_BAUD_PROBE_READS)){
+            return false;
+        }
+    }
+    return true;
+}
+
+esp_err_t modbus_negotiate_baudrate(uint32_t* baudrate){
+    if((baudrate == NULL) || (num_poll_blocks == 0)){
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(bus_baudrate != init_baudrate){
+        set_bus_baudrate(init_baudrate);
+    }
+    bool present[MB_SLAVE_MAX] = {0};
+    uint8_t present_count = 0;
+    uint32_t present_mask = 0;
+    for(uint8_t slave = 0; slave < num_slaves; slave++){
+        present[slave] = probe_slave(slave, 1);
+        absent[slave] = !present[slave];
+        portENTER_CRITICAL(&slaves_lock);
+        slaves[slave].online = present[slave];      //The poll retries a missing slave with its backoff.
+        portEXIT_CRITICAL(&slaves_lock);
+        present_count += present[slave];
+        present_mask |= (uint32_t)present[slave] << slave;
+    }
+    reprobe_at = esp_timer_get_time() + (int64_t)MB_BAUD_REPROBE_MS * 1000;
+    *baudrate = init_baudrate;
+    if(present_count == 0){
+        ESP_LOGW(TAG, "No slave answers at %" PRIu32 " baud, keeping it", init_baudrate);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    nvs_handle_t nvs;
+    uint32_t stored = 0;
+    uint32_t stored_mask = 0;
+    bool nvs_ok = (nvs_open(MB_BAUD_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK);
+    if(nvs_ok){
+        nvs_get_u32(nvs, MB_BAUD_NVS_KEY, &stored);
+        nvs_get_u32(nvs, MB_BAUD_NVS_SLAVES_KEY, &stored_mask);
+    }
+
+    uint32_t chosen = init_baudrate;
+    bool same_slaves = (stored_mask == present_mask);
+    bool stored_tried = (stored > init_baudrate);
+    if(same_slaves && (stored == init_baudrate)){
+        ESP_LOGI(TAG, "No faster rate worked for these slaves last time, not searching");
+    }else if(stored_tried && probe_baudrate(stored, present)){
+        chosen = stored;            //The rate of the last boot still works, no need to search.
+    }else{
+        for(uint16_t i = 0; i < sizeof(baud_candidates)/sizeof(baud_candidates[0]); i++){
+            if(baud_candidates[i] <= init_baudrate){
+                break;
+            }
+            if(stored_tried && (baud_candidates[i] == stored)){
+                continue;
+            }
+            if(probe_baudrate(baud_candidates[i], present)){
+                chosen = baud_candidates[i];
+                break;
+            }
+            ESP_LOGI(TAG, "%" PRIu32 " baud rejected", baud_candidates[i]);
+        }
+    }
+    if(bus_baudrate != chosen){
+        set_bus_baudrate(chosen);
+    }
+    ESP_LOGI(TAG, "Bus running at %" PRIu32 " baud (%u slaves probed)", chosen, (unsigned)present_count);
+
+    if(nvs_ok){
+        if((chosen != stored) || !same_slaves){
+            if((nvs_set_u32(nvs, MB_BAUD_NVS_KEY, chosen) != ESP_OK)
+               || (nvs_set_u32(nvs, MB_BAUD_NVS_SLAVES_KEY, present_mask) != ESP_OK) || (nvs_commit(nvs) != ESP_OK)){
+                ESP_LOGW(TAG, "Failed to store the baud rate");
+            }
+        }
+        nvs_close(nvs);
+    }
+    *baudrate = chosen;
+    return ESP_OK;
+}
+
+/*
+ * Probe the slaves missing at negotiation at the init rate, from the poll, when the bus is idle.
+ * A slave the poll found at the running rate is no longer missing. One that only answers at the
+ * init rate makes the bus negotiate again with it.
+*/
+static void reprobe_absent_slaves(void){
+    if((reprobe_at == 0) || (esp_timer_get_time() < reprobe_at) || (modbus_async_pending() > 0)){
+        return;
+    }
+    reprobe_at = esp_timer_get_time() + (int64_t)MB_BAUD_REPROBE_MS * 1000;
+    bool found = false;
+    bool missing = false;
+    for(uint8_t slave = 0; slave < num_slaves; slave++){
+        if(absent[slave] && slaves[slave].online){
+            absent[slave] = false;
+        }
+        missing |= absent[slave];
+    }
+    if(!missing || (bus_baudrate == init_baudrate)){
+        return;                     //At the init rate the poll itself retries them.
+    }
+    uint32_t running = bus_baudrate;
+    set_bus_baudrate(init_baudrate);
+    for(uint8_t slave = 0; (slave < num_slaves) && !found; slave++){
+        found = absent[slave] && probe_slave(slave, 1);
+    }
+    if(!found){
+        set_bus_baudrate(running);
+        return;
+    }
+    uint32_t baudrate;
+    ESP_LOGI(TAG, "A missing slave answers at %" PRIu32 " baud, negotiating again", init_baudrate);
+    modbus_negotiate_baudrate(&baudrate);
+}
+
+esp_err_t read_modbus_block(void){
+    return read_slaves_due(NULL);
+}
+
+esp_err_t read_modbus_due(const bool* due){
+    return read_slaves_due(due);
+}
+
+esp_err_t get_modbus_points(uint8_t slave, uint16_t first_cid, uint16_t count, modbus_point_t* points){
+    if((points == NULL) || (slave >= num_slaves) || (count == 0) || (first_cid + count > num_device_parameters)){
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t spins = 0;
+    while(1){
+        uint32_t seq = __atomic_load_n(&snapshot_seq[slave], __ATOMIC_ACQUIRE);
+        if(!(seq & 1)){
+            for(uint16_t i = 0; i < count; i++){
+                const mb_parameter_descriptor_t* param = &device_parameters[first_cid + i];
+                size_t size = param->param_size;
+                if(size > MODBUS_POINT_MAX_SIZE){
+                    size = MODBUS_POINT_MAX_SIZE;
+                }
+                memcpy(points[i].value, slave_param_data(slave, param), size);
+                points[i].seq = point_meta[slave][first_cid + i].seq;
+                points[i].timestamp = point_meta[slave][first_cid + i].timestamp;
+            }
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if(__atomic_load_n(&snapshot_seq[slave], __ATOMIC_RELAXED) == seq){
+                return ESP_OK;
+            }
+        }
+        //Torn copy, the request task was decoding. It is only preempted by higher priority work.
+        if(++spins >= MB_SNAPSHOT_SPINS){
+            vTaskDelay(1);
+            spins = 0;
+        }
     }
-    err = mbc_master_get_parameter(cid_, (char*)param_descriptor->param_key, (uint8_t*)temp_data_ptr, &type);
+}
+
+esp_err_t get_modbus_point(uint8_t slave, uint16_t cid_, modbus_point_t* point){
+    return get_modbus_points(slave, cid_, 1, point);
+}
+
+esp_err_t read_modbus_data(uint16_t cid_, modbus_point_t* point){
+    if((cid_ >= num_device_parameters) || (point == NULL)){
+        return ESP_ERR_INVALID_ARG;
+    }
+    const mb_parameter_descriptor_t* param = &device_parameters[cid_];
+    uint16_t block_index = 0;
+    while((block_index < num_poll_blocks) && ((cid_ < poll_blocks[block_index].first_cid)
+            || (cid_ >= poll_blocks[block_index].first_cid + poll_blocks[block_index].cid_count))){
+        block_index++;
+    }
+    if(block_index >= num_poll_blocks){
+        printf("CID %u can not be read\n", (unsigned)cid_);
+        return ESP_ERR_INVALID_ARG;
+    }
+    //Goes through the request task like the poll, so the snapshot keeps a single writer.
+    StaticSemaphore_t done_buffer;
+    esp_err_t result = ESP_OK;
+    modbus_poll_request_t poll = {
+        .slave = 0,
+        .block = &poll_blocks[block_index],
+        .first_cid = cid_,
+        .last_cid = cid_,
+        .pending = true,
+        .done = xSemaphoreCreateBinaryStatic(&done_buffer),
+        .result = &result
+    };
+    mb_param_request_t request = {
+        .slave_addr = slaves[0].addr,
+        .command = block_command(param->mb_param_type),
+        .reg_start = param->mb_reg_start,
+        .reg_size = param->mb_size
+    };
+    esp_err_t err = modbus_async_submit(&request, NULL, 0, poll_request_done, &poll, portMAX_DELAY);
+    if(err == ESP_OK){
+        xSemaphoreTake(poll.done, portMAX_DELAY);
+        err = result;
+    }
+    vSemaphoreDelete(poll.done);
     if (err != ESP_OK) {
         printf("Failed to get parameter, error: %s\n", esp_err_to_name(err));
-        return NULL; 
+        return err;
+    }
+    return get_modbus_point(0, cid_, point);
+}
+
+//Completion of a write, nobody waits for it.
+static void write_request_done(esp_err_t err, const mb_param_request_t* request, const void* data,
+                               uint32_t latency_us, void* arg){
+    if(err != ESP_OK){
+        printf("Failed to set parameter data at %u (slave %u), error: %s\n",
+               (unsigned)request->reg_start, (unsigned)request->slave_addr, esp_err_to_name(err));
+        send_to_oled("MB WR ERROR",true);
     }
-    return temp_data_ptr;
 }
 
 esp_err_t write_modbus_data(uint16_t cid_, void * data){
     esp_err_t err;
     mb_parameter_descriptor_t* param_descriptor = NULL;
-    uint8_t type = 0;
-    void * temp_data_ptr = data;
+    uint16_t regs[MB_WRITE_MAX_REGS] = {0};
     
     err = mbc_master_get_cid_info(cid_, &param_descriptor);
     if (err != ESP_OK || param_descriptor == NULL) {
         printf("Failed to get CID info, error: %s\n", esp_err_to_name(err));
         return err; 
     }
-    err = mbc_master_set_parameter(cid_,(char *)param_descriptor->param_key,(uint8_t *)temp_data_ptr,&type);
+    uint8_t command = 0;
+    switch(param_descriptor->mb_param_type){
+        case MB_PARAM_HOLDING:  command = MB_FC_WRITE_MULTIPLE_REGISTERS; break;
+        case MB_PARAM_COIL:     command = MB_FC_WRITE_MULTIPLE_COILS; break;
+        default:                break;
+    }
+    if((command == 0) || (param_descriptor->mb_size > MB_WRITE_MAX_REGS)){
+        printf("CID %u can not be written\n", (unsigned)cid_);
+        return ESP_ERR_INVALID_ARG;
+    }
+    err = mbc_master_set_param_data((void*)regs, data, param_descriptor->param_type, param_descriptor->param_size);
     if (err != ESP_OK) {
         printf("Failed to set parameter data\n");
         return err;
     }
+    mb_param_request_t request = {
+        .slave_addr = slaves[0].addr,
+        .command = command,
+        .reg_start = param_descriptor->mb_reg_start,
+        .reg_size = param_descriptor->mb_size
+    };
+    //Queued behind the running poll, the caller (MQTT event handler) does not wait for the bus.
+    err = modbus_async_submit(&request, regs, 0, write_request_done, NULL, pdMS_TO_TICKS(MB_WRITE_QUEUE_WAIT_MS));
+    if (err != ESP_OK) {
+        printf("Failed to queue parameter write, error: %s\n", esp_err_to_name(err));
+        return err;
+    }
     return ESP_OK;
 }
 
@@ -300,7 +996,50 @@ bool modbus_data_to_bool(void *data){
     return value;
 }
 
+//Completion of one waveform chunk, arg is where the registers go in the capture.
+static void waveform_chunk_done(esp_err_t err, const mb_param_request_t* request, const void* data,
+                                uint32_t latency_us, void* arg){
+    if(err == ESP_OK){
+        memcpy(arg, data, request->reg_size * sizeof(uint16_t));
+    }else{
+        printf("Failed to read waveform at %u, error: %s\n",
+               (unsigned)request->reg_start, esp_err_to_name(err));
+        if(local_result == ESP_OK){
+            local_result = err;
+        }
+    }
+    xSemaphoreGive(local_done);
+}
 
-
-
-#endif
\ No newline at end of file
+waveform_reg_params_t* read_modbus_waveform(void){
+    waveform_reg_params_t* capture = &waveform_ring[waveform_seq % WAVEFORM_RING_DEPTH];
+    uint16_t* regs = (uint16_t*)capture->input_x;
+    uint16_t submitted = 0;
+    local_result = ESP_OK;
+    //All chunks are queued at once and go out back to back.
+    for(uint16_t offset = 0; offset < WAVEFORM_REG_COUNT; offset += MB_BLOCK_MAX_REGS){
+        uint16_t chunk = WAVEFORM_REG_COUNT - offset;
+        if(chunk > MB_BLOCK_MAX_REGS){
+            chunk = MB_BLOCK_MAX_REGS;
+        }
+        mb_param_request_t request = {
+            .slave_addr = slaves[0].addr,
+            .command = MB_FC_READ_INPUT,
+            .reg_start = WAVEFORM_REG_START + offset,
+            .reg_size = chunk
+        };
+        //Full frames take much longer than the poll blocks, keep the configured respond timeout.
+        esp_err_t err = modbus_async_submit(&request, NULL, 0, waveform_chunk_done, (void*)&regs[offset], portMAX_DELAY);
+        if(err != ESP_OK){
+            local_result = err;
+            break;
+        }
+        submitted++;
+    }
+    if(wait_local_requests(submitted) != ESP_OK){
+        return NULL;
+    }
+    capture->seq = waveform_seq++;
+    capture->timestamp = esp_timer_get_time();
+    return capture;
+}
@@ -11,14 +11,40 @@ extern "C" {
 
 #define samples 128
 
+#define MB_SLAVE_MAX    8           //Slaves that can be polled with the descriptor template.
+
+//MPU waveform captured in one burst, the three axes are read back to back from the slave.
 typedef struct{
       int16_t input_x[samples];
       int16_t input_y[samples];
       int16_t input_z[samples];
-      float input_current;
-      float input_flow_rate;
-      float input_total_flow;
-}input_reg_params_t;
+      uint32_t seq;                 //Capture number, increases by one for every burst.
+      int64_t timestamp;            //esp_timer time (us) at the end of the burst.
+}waveform_reg_params_t;
+
+//Health of one polled slave, updated on every request of read_modbus_block()/read_modbus_due().
+typedef struct{
+      uint8_t addr;
+      bool online;                  //False from a failed request until the slave answers again.
+      uint32_t requests;
+      uint32_t errors;              //Failed requests, timeouts included.
+      uint32_t timeouts;
+      uint32_t consecutive_errors;
+      uint32_t last_latency_us;
+      uint32_t avg_latency_us;      //Moving average over ~8 requests.
+      uint32_t max_latency_us;
+      uint32_t timeout_ms;          //Respond timeout used for this slave.
+      int64_t retry_at;             //esp_timer time (us), an offline slave is skipped until then.
+}modbus_slave_health_t;
+
+#define MODBUS_POINT_MAX_SIZE   8           //Largest parameter (64 bits).
+
+//Copy of one polled value, taken from the snapshot store without blocking the poll.
+typedef struct{
+      uint8_t value[MODBUS_POINT_MAX_SIZE];   //Parameter as decoded, read it with modbus_data_to_xxx().
+      uint32_t seq;                 //Number of updates of this point since boot, 0 if never read.
+      int64_t timestamp;            //esp_timer time (us) of the last update.
+}modbus_point_t;
 
 
 //Initialise modbus RTU connection with the following settings:
@@ -34,13 +60,54 @@ typedef struct{
 
 esp_err_t modbusRTU_init(uint32_t baudrate);
 
+/*
+ * Switch the bus to the fastest rate every answering slave reads cleanly at, after modbusRTU_init().
+ * The init rate is the fallback, and the chosen rate is kept in NVS for the next boot, with the slaves
+ * it was found for, so a bus where no faster rate works is not searched again at every boot.
+ * A slave missing here is probed again at the init rate from the poll, and the bus renegotiated once it answers.
+ * The T3.5 inter-frame timing of the stack follows the rate.
+*/
+esp_err_t modbus_negotiate_baudrate(uint32_t* baudrate);
+
 //The below function from ESP32 modbus serial master example.
 void* master_get_param_data(const mb_parameter_descriptor_t* param_descriptor);
 
-void* read_modbus_data(uint16_t cid_);
+//Read one CID of the first slave now, queued behind the running poll, and return its updated point.
+esp_err_t read_modbus_data(uint16_t cid_, modbus_point_t* point);
 
 esp_err_t write_modbus_data(uint16_t cid_, void* data);
 
+/*
+ * Slave addresses polled with the descriptor template, call it before modbusRTU_init().
+ * The first one should stay the template address (the local pump), it is the one
+ * read_modbus_block()/read_modbus_due() report on and the target of read_modbus_data()/write_modbus_data() and the waveform burst.
+*/
+esp_err_t modbus_set_slaves(const uint8_t* addrs, uint8_t count);
+
+uint8_t modbus_slave_count(void);
+
+esp_err_t modbus_get_slave_health(uint8_t slave, modbus_slave_health_t* health);
+
+//Read every readable CID of every slave using one request per block of adjacent registers.
+//Returns the result of the first slave, the other slaves are reported by modbus_get_slave_health().
+esp_err_t read_modbus_block(void);
+
+//Read only the CIDs flagged in due[] (indexed by CID), merged per block like read_modbus_block().
+esp_err_t read_modbus_due(const bool* due);
+
+/*
+ * Last value of a CID of the slave at index slave of modbus_set_slaves(), no bus access.
+ * Safe from any task while the poll runs: the copy is never half old, half new.
+*/
+esp_err_t get_modbus_point(uint8_t slave, uint16_t cid_, modbus_point_t* point);
+
+//Same for count CIDs from first_cid, all taken from the same state of the slave.
+esp_err_t get_modbus_points(uint8_t slave, uint16_t first_cid, uint16_t count, modbus_point_t* points);
+
+//Read the 3x128 sample waveform into the next buffer of the capture ring.
+//The buffer stays valid until the ring wraps around (WAVEFORM_RING_DEPTH bursts later).
+waveform_reg_params_t* read_modbus_waveform(void);
+
 float modbus_data_to_float(void *data);   //For registers.
 
 int16_t modbus_data_to_int(void *data);   //For registers.
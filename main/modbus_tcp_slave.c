@@ -0,0 +1,153 @@
+#include "modbus_tcp_slave.h"
+#include <string.h>
+#include <mbcontroller.h>
+#include "esp_netif.h"
+#include "esp_log.h"
+#include "modbus_rtu.h"
+
+#define TAG "MODBUS TCP"
+
+#define MODBUS_TCP_UID              1           //Unit identifier, ignored unless FMB_TCP_UID_ENABLED is set.
+#define MODBUS_TCP_CACHE_REGS       (MB_SLAVE_MAX * MODBUS_TCP_SLAVE_STRIDE)
+#define MODBUS_TCP_EVENT_TASK_STACK 3072
+#define MODBUS_TCP_READ_EVENTS      (MB_EVENT_INPUT_REG_RD | MB_EVENT_HOLDING_REG_RD | MB_EVENT_COILS_RD)
+
+//Register image of every polled slave, in the layout the slaves use on the RS485 bus.
+static uint16_t cache_regs[MODBUS_TCP_CACHE_REGS];
+static uint8_t cache_coils[(MODBUS_TCP_CACHE_REGS + 7) / 8];
+static bool started = false;
+
+/*
+ * The stack queues an access notice for every request and waits MB_PAR_INFO_TOUT for room once
+ * its queue is full, so the notices are taken here as they come, the way the esp-modbus examples do.
+ * Runs at the priority of the stack task so it gets the notice before the next request.
+*/
+static void modbus_tcp_event_task(void* arg){
+    mb_param_info_t info;
+    for(;;){
+        mbc_slave_check_event(MODBUS_TCP_READ_EVENTS);
+        if(mbc_slave_get_param_info(&info, MB_PAR_INFO_TOUT) == ESP_OK){
+            ESP_LOGD(TAG, "Read of %u registers at %u", (unsigned)info.size, (unsigned)info.mb_offset);
+        }
+    }
+}
+
+esp_err_t modbus_tcp_slave_start(void){
+    if(started){
+        return ESP_OK;
+    }
+    void* slave_handler = NULL;
+    esp_err_t err = mbc_slave_init_tcp(&slave_handler);
+    if(err != ESP_OK){
+        ESP_LOGE(TAG, "Init failed : %s", esp_err_to_name(err));
+        return err;
+    }
+    mb_communication_info_t comm;
+    memset(&comm, 0, sizeof(comm));
+    comm.ip_mode = MB_MODE_TCP;
+    comm.slave_uid = MODBUS_TCP_UID;
+    comm.ip_port = CONFIG_FMB_TCP_PORT_DEFAULT;
+    comm.ip_addr_type = MB_IPV4;
+    comm.ip_addr = NULL;                //Accept any client.
+    comm.ip_netif_ptr = (void*)esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    err = mbc_slave_setup((void*)&comm);
+    if(err != ESP_OK){
+        ESP_LOGE(TAG, "Setup failed : %s", esp_err_to_name(err));
+        return err;
+    }
+
+    mb_register_area_descriptor_t areas[] = {
+        { 0, MB_PARAM_INPUT, (void*)cache_regs, sizeof(cache_regs) },
+        { 0, MB_PARAM_HOLDING, (void*)cache_regs, sizeof(cache_regs) },
+        { 0, MB_PARAM_COIL, (void*)cache_coils, sizeof(cache_coils) }
+    };
+    for(uint8_t i = 0; i < sizeof(areas)/sizeof(areas[0]); i++){
+        err = mbc_slave_set_descriptor(areas[i]);
+        if(err != ESP_OK){
+            ESP_LOGE(TAG, "Area %u failed : %s", (unsigned)i, esp_err_to_name(err));
+            return err;
+        }
+    }
+    mbc_slave_set_read_only(true);      //INPUT and HOLDING share the cache, a client write would corrupt it.
+    err = mbc_slave_start();
+    if(err != ESP_OK){
+        ESP_LOGE(TAG, "Start failed : %s", esp_err_to_name(err));
+        return err;
+    }
+    if(xTaskCreatePinnedToCore(modbus_tcp_event_task, "mb_tcp_events", MODBUS_TCP_EVENT_TASK_STACK, NULL,
+                               CONFIG_FMB_PORT_TASK_PRIO, NULL, CONFIG_FMB_PORT_TASK_AFFINITY) != pdPASS){
+        ESP_LOGE(TAG, "Event task failed");
+        return ESP_ERR_NO_MEM;
+    }
+    started = true;
+    ESP_LOGI(TAG, "Serving the register cache on port %d", CONFIG_FMB_TCP_PORT_DEFAULT);
+    return ESP_OK;
+}
+
+void modbus_tcp_slave_update(uint8_t slave, uint16_t first_cid, uint16_t last_cid){
+    if(slave >= MB_SLAVE_MAX){
+        return;
+    }
+    for(uint16_t cid = first_cid; cid <= last_cid; cid++){
+        const mb_parameter_descriptor_t* param = NULL;
+        if((mbc_master_get_cid_info(cid, &param) != ESP_OK) || (param == NULL)){
+            continue;
+        }
+        modbus_point_t point;
+        if((get_modbus_point(slave, cid, &point) != ESP_OK) || (param->mb_reg_start + param->mb_size > MODBUS_TCP_SLAVE_STRIDE)){
+            continue;
+        }
+        const uint8_t* value = point.value;
+        uint16_t base = slave * MODBUS_TCP_SLAVE_STRIDE + param->mb_reg_start;
+        switch(param->mb_param_type){
+            case MB_PARAM_INPUT:
+            case MB_PARAM_HOLDING: {
+                //The decoded value keeps the register layout, it goes back as it came.
+                size_t size = param->param_size;
+                if(size > MODBUS_POINT_MAX_SIZE){
+                    size = MODBUS_POINT_MAX_SIZE;
+                }
+                if(size > (size_t)(param->mb_size << 1)){
+                    size = param->mb_size << 1;
+                }
+                mbc_slave_lock();
+                memcpy(&cache_regs[base], value, size);
+                mbc_slave_unlock();
+                break;
+            }
+            case MB_PARAM_COIL:
+            case MB_PARAM_DISCRETE: {
+                //The bits are merged into a copy of the bytes they span, only the copy back is locked.
+                //This task is the only writer of the cache, the slave refuses client writes.
+                uint8_t bits[MODBUS_POINT_MAX_SIZE + 1];
+                uint16_t count = param->mb_size;
+                if(count > param->param_size * 8){
+                    count = param->param_size * 8;
+                }
+                if(count > MODBUS_POINT_MAX_SIZE * 8){
+                    count = MODBUS_POINT_MAX_SIZE * 8;
+                }
+                if(count == 0){
+                    break;
+                }
+                uint16_t first = base >> 3;
+                uint16_t bytes = ((base + count - 1) >> 3) - first + 1;
+                memcpy(bits, &cache_coils[first], bytes);
+                for(uint16_t bit = 0; bit < count; bit++){
+                    uint16_t dest = (base & 7) + bit;
+                    if(value[bit >> 3] & (1 << (bit & 7))){
+                        bits[dest >> 3] |= (1 << (dest & 7));
+                    }else{
+                        bits[dest >> 3] &= ~(1 << (dest & 7));
+                    }
+                }
+                mbc_slave_lock();
+                memcpy(&cache_coils[first], bits, bytes);
+                mbc_slave_unlock();
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _MODBUS_TCP_SLAVE_H_
+#define _MODBUS_TCP_SLAVE_H_
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include "esp_err.h"
+
+/*
+ * Modbus TCP server answering from the register cache of the RTU poll, never from the RS485 bus.
+ * Every polled slave gets its own window of MODBUS_TCP_SLAVE_STRIDE registers and coils:
+ * slave index k (order of modbus_set_slaves()) is at k * MODBUS_TCP_SLAVE_STRIDE + its RTU address,
+ * so the first slave keeps the register map of the pump.
+ * Input registers are also readable as holding registers (FC03).
+ * The cache is read only: writes from clients are refused with an illegal data address exception.
+*/
+#define MODBUS_TCP_SLAVE_STRIDE     100
+
+//Start the server on the Wi-Fi station interface, after the connection is up.
+esp_err_t modbus_tcp_slave_start(void);
+
+//Copy the last polled values of CIDs first_cid..last_cid of a slave into the cache.
+void modbus_tcp_slave_update(uint8_t slave, uint16_t first_cid, uint16_t last_cid);
+
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
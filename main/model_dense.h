@@ -0,0 +1,42 @@
+// Generated by tools/dense_codegen.py from model.cc, do not edit.
+// Layers: 3->3 Relu, 3->2 Relu, 2->3 Logistic.
+
+#ifndef _MODEL_DENSE_H_
+#define _MODEL_DENSE_H_
+
+#include "dense_engine.h"
+
+namespace dense {
+
+constexpr int kSourceModelLength = 2488;
+constexpr uint32_t kSourceModelHash = 0xd45f2bedu;
+
+using Model = Network<
+    Layer<3, 3, Activation::kRelu>,
+    Layer<3, 2, Activation::kRelu>,
+    Layer<2, 3, Activation::kLogistic>>;
+
+constexpr Model kModel = {
+  {{
+    {-0.17022109f, -0.379535198f, -0.184310913f},
+    {0.00326082786f, -0.175619796f, 0.908244848f},
+    {0.0817914754f, 1.62521088f, 0.213280484f},
+  }, {0.0f, 0.0867598727f, 0.00128541817f}},
+  {
+    {{
+      {-0.623825669f, -0.865450025f, 1.2983036f},
+      {0.27872932f, 1.14350569f, -0.136279061f},
+    }, {0.0230912212f, 0.170364305f}},
+    {
+      {{
+        {-0.0498177856f, -0.321099997f},
+        {1.13940525f, -0.991395593f},
+        {-0.720774889f, 1.44417739f},
+      }, {-0.091841884f, -0.481906295f, -0.262399435f}},
+    },
+  },
+};
+
+}  // namespace dense
+
+#endif  // _MODEL_DENSE_H_
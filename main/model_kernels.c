@@ -0,0 +1,64 @@
+#include "model_kernels.h"
+#include <math.h>
+
+void scale_rows_f32_ansi(const float* in, float* out, int rows, int cols, const float* scale, const float* offset){
+    for(int row = 0; row < rows; row++){
+        for(int col = 0; col < cols; col++){
+            out[row * cols + col] = in[row * cols + col] * scale[col] + offset[col];
+        }
+    }
+}
+
+void scale_rows_f32_opt(const float* in, float* out, int rows, int cols, const float* scale, const float* offset){
+    for(int row = 0; row < rows; row++){
+        int col = 0;
+        for(; col + 4 <= cols; col += 4){
+            float v0 = in[col] * scale[col] + offset[col];
+            float v1 = in[col + 1] * scale[col + 1] + offset[col + 1];
+            float v2 = in[col + 2] * scale[col + 2] + offset[col + 2];
+            float v3 = in[col + 3] * scale[col + 3] + offset[col + 3];
+            out[col] = v0;
+            out[col + 1] = v1;
+            out[col + 2] = v2;
+            out[col + 3] = v3;
+        }
+        for(; col < cols; col++){
+            out[col] = in[col] * scale[col] + offset[col];
+        }
+        in += cols;
+        out += cols;
+    }
+}
+
+void mae_rows_f32_ansi(const float* a, const float* b, int rows, int cols, float* mae){
+    for(int row = 0; row < rows; row++){
+        float sum = 0.0f;
+        for(int col = 0; col < cols; col++){
+            sum += fabsf(a[row * cols + col] - b[row * cols + col]);
+        }
+        mae[row] = sum / cols;
+    }
+}
+
+void mae_rows_f32_opt(const float* a, const float* b, int rows, int cols, float* mae){
+    const float inv_cols = 1.0f / cols;
+    for(int row = 0; row < rows; row++){
+        float sum0 = 0.0f;
+        float sum1 = 0.0f;
+        float sum2 = 0.0f;
+        float sum3 = 0.0f;
+        int col = 0;
+        for(; col + 4 <= cols; col += 4){
+            sum0 += fabsf(a[col] - b[col]);
+            sum1 += fabsf(a[col + 1] - b[col + 1]);
+            sum2 += fabsf(a[col + 2] - b[col + 2]);
+            sum3 += fabsf(a[col + 3] - b[col + 3]);
+        }
+        for(; col < cols; col++){
+            sum0 += fabsf(a[col] - b[col]);
+        }
+        mae[row] = ((sum0 + sum1) + (sum2 + sum3)) * inv_cols;
+        a += cols;
+        b += cols;
+    }
+}
@@ -0,0 +1,55 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _MODEL_KERNELS_H_
+#define _MODEL_KERNELS_H_
+
+#include "sdkconfig.h"
+
+/*
+ * Pre and post processing of the autoencoder over whole batches of rows (row major, cols values each).
+ * Like esp-nn, every kernel has an _ansi reference and an _opt version picked with CONFIG_NN_OPTIMIZED:
+ * four independent accumulators per loop so the FPU pipeline stays full, with an ANSI tail.
+ * These are unrolled C, not esp-dsp routines. Below MODEL_KERNELS_OPT_MIN_COLS columns there is no
+ * 4-wide loop to run and the set up costs more than it saves (measured 0.74x-0.82x at 3 columns),
+ * so scale_rows_f32() and mae_rows_f32() send narrow rows, the 3 inputs of the shipped model
+ * included, to _ansi and only wider ones to _opt.
+ * tools/host_checks/run.sh checks _opt against _ansi and times both.
+*/
+#define MODEL_KERNELS_OPT_MIN_COLS  4
+
+//Min-max scaling with the affine form of each column: out = in * scale[col] + offset[col].
+void scale_rows_f32_ansi(const float* in, float* out, int rows, int cols, const float* scale, const float* offset);
+void scale_rows_f32_opt(const float* in, float* out, int rows, int cols, const float* scale, const float* offset);
+
+//Mean absolute error between the rows of a and b, one value per row in mae.
+void mae_rows_f32_ansi(const float* a, const float* b, int rows, int cols, float* mae);
+void mae_rows_f32_opt(const float* a, const float* b, int rows, int cols, float* mae);
+
+static inline void scale_rows_f32(const float* in, float* out, int rows, int cols, const float* scale, const float* offset){
+#if defined(CONFIG_NN_OPTIMIZED)
+    if(cols >= MODEL_KERNELS_OPT_MIN_COLS){
+        scale_rows_f32_opt(in, out, rows, cols, scale, offset);
+        return;
+    }
+#endif
+    scale_rows_f32_ansi(in, out, rows, cols, scale, offset);
+}
+
+static inline void mae_rows_f32(const float* a, const float* b, int rows, int cols, float* mae){
+#if defined(CONFIG_NN_OPTIMIZED)
+    if(cols >= MODEL_KERNELS_OPT_MIN_COLS){
+        mae_rows_f32_opt(a, b, rows, cols, mae);
+        return;
+    }
+#endif
+    mae_rows_f32_ansi(a, b, rows, cols, mae);
+}
+
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
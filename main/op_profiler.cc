@@ -0,0 +1,88 @@
+#include "op_profiler.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_cpu.h"
+#include "sdkconfig.h"
+
+#define CYCLES_PER_US   CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+
+void OpProfiler::BeginInvoke() {
+  next_op_ = 0;
+  invokes_++;
+}
+
+uint32_t OpProfiler::BeginEvent(const char* tag) {
+  int op = next_op_++;
+  if (op >= kMaxOps) {
+    return kMaxOps;         // Not recorded, EndEvent ignores it.
+  }
+  OpStats* stats = &ops_[op];
+  if (stats->tag != tag) {
+    // First invoke, or the graph changed: the node starts over.
+    memset(stats, 0, sizeof(*stats));
+    stats->tag = tag;
+    stats->min_cycles = UINT32_MAX;
+  }
+  if (op >= num_ops_) {
+    num_ops_ = op + 1;
+  }
+  stats->start_cycles = esp_cpu_get_cycle_count();
+  return op;
+}
+
+void OpProfiler::EndEvent(uint32_t event_handle) {
+  uint32_t end = esp_cpu_get_cycle_count();
+  if (event_handle >= kMaxOps) {
+    return;
+  }
+  OpStats* stats = &ops_[event_handle];
+  uint32_t cycles = end - stats->start_cycles;
+  stats->count++;
+  stats->total_cycles += cycles;
+  if (cycles < stats->min_cycles) {
+    stats->min_cycles = cycles;
+  }
+  if (cycles > stats->max_cycles) {
+    stats->max_cycles = cycles;
+  }
+}
+
+size_t OpProfiler::Report(char* buffer, size_t size) {
+  int length = snprintf(buffer, size, "{\"model\":\"%s\",\"invokes\":%u,\"ops\":[",
+                        name_, (unsigned)invokes_);
+  printf("\n%s model, %u invokes: node op min/avg/max us\n", name_, (unsigned)invokes_);
+  uint64_t total_cycles = 0;
+  bool first = true;
+  for (int op = 0; op < num_ops_; op++) {
+    OpStats* stats = &ops_[op];
+    if (stats->count == 0) {
+      continue;
+    }
+    float min_us = (float)stats->min_cycles / CYCLES_PER_US;
+    float avg_us = (float)stats->total_cycles / stats->count / CYCLES_PER_US;
+    float max_us = (float)stats->max_cycles / CYCLES_PER_US;
+    total_cycles += stats->total_cycles / stats->count;
+    printf("%2d %-20s %8.1f %8.1f %8.1f\n", op, stats->tag, min_us, avg_us, max_us);
+    if ((length >= 0) && ((size_t)length < size)) {
+      length += snprintf(&buffer[length], size - length,
+                         "%s{\"node\":%d,\"op\":\"%s\",\"min_us\":%.1f,\"avg_us\":%.1f,\"max_us\":%.1f}",
+                         first ? "" : ",", op, stats->tag, min_us, avg_us, max_us);
+      first = false;
+    }
+    // New window, the node keeps its tag.
+    stats->count = 0;
+    stats->total_cycles = 0;
+    stats->min_cycles = UINT32_MAX;
+    stats->max_cycles = 0;
+  }
+  float total_us = (float)total_cycles / CYCLES_PER_US;
+  printf("   total (avg)          %8.1f\n", total_us);
+  if ((length >= 0) && ((size_t)length < size)) {
+    length += snprintf(&buffer[length], size - length, "],\"total_avg_us\":%.1f}", total_us);
+  }
+  invokes_ = 0;
+  if ((length < 0) || ((size_t)length >= size)) {
+    return 0;
+  }
+  return length;
+}
@@ -0,0 +1,47 @@
+#ifndef _OP_PROFILER_H_
+#define _OP_PROFILER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "tensorflow/lite/micro/micro_profiler_interface.h"
+
+// Per-operator timing of a MicroInterpreter, aggregated over a window of
+// invokes into min/avg/max per node. The stock MicroProfiler keeps every
+// event (4096 of them) and does not fit next to the rest of the firmware,
+// this one only keeps one line per node.
+class OpProfiler : public tflite::MicroProfilerInterface {
+ public:
+  static constexpr int kMaxOps = 16;
+
+  explicit OpProfiler(const char* name) : name_(name) {}
+
+  // Call before every Invoke(), events are matched to nodes by their order.
+  void BeginInvoke();
+
+  uint32_t BeginEvent(const char* tag) override;
+  void EndEvent(uint32_t event_handle) override;
+
+  uint32_t invokes() const { return invokes_; }
+
+  // Print the window on the console and write it as JSON into buffer,
+  // then start a new window. Returns the JSON length, 0 if it did not fit.
+  size_t Report(char* buffer, size_t size);
+
+ private:
+  struct OpStats {
+    const char* tag;
+    uint32_t count;
+    uint64_t total_cycles;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint32_t start_cycles;
+  };
+
+  const char* name_;
+  OpStats ops_[kMaxOps] = {};
+  int num_ops_ = 0;
+  int next_op_ = 0;
+  uint32_t invokes_ = 0;
+};
+
+#endif  // _OP_PROFILER_H_
@@ -0,0 +1,137 @@
+#include "poll_scheduler.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#define TAG "POLL SCHEDULER"
+
+//Points due within this window are served together with the earliest one.
+#define POLL_MERGE_WINDOW_US    (50 * 1000)
+
+typedef struct{
+    bool used;
+    uint32_t period_us;
+    uint32_t deadline_us;
+    int64_t next_due;                   //esp_timer time (us).
+    uint32_t misses;
+}poll_state_t;
+
+static poll_state_t states[POLL_MAX_POINTS];
+static portMUX_TYPE states_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t waiting_task = NULL;
+static volatile bool running = false;
+
+esp_err_t poll_scheduler_init(const poll_point_t* table, uint16_t count){
+    if((table == NULL) || (count == 0)){
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(states, 0, sizeof(states));
+    for(uint16_t i = 0; i < count; i++){
+        if((table[i].id >= POLL_MAX_POINTS) || (table[i].period_ms == 0)){
+            ESP_LOGE(TAG, "Wrong poll point %u", (unsigned)i);
+            return ESP_ERR_INVALID_ARG;
+        }
+        poll_state_t* state = &states[table[i].id];
+        state->used = true;
+        state->period_us = table[i].period_ms * 1000;
+        state->deadline_us = table[i].deadline_ms * 1000;
+    }
+    return ESP_OK;
+}
+
+void poll_scheduler_start(void){
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&states_lock);
+    for(uint16_t id = 0; id < POLL_MAX_POINTS; id++){
+        states[id].next_due = now;
+    }
+    running = true;
+    portEXIT_CRITICAL(&states_lock);
+    if(waiting_task != NULL){
+        xTaskNotifyGive(waiting_task);
+    }
+}
+
+void poll_scheduler_stop(void){
+    running = false;
+    if(waiting_task != NULL){
+        xTaskNotifyGive(waiting_task);
+    }
+}
+
+bool poll_scheduler_running(void){
+    return running;
+}
+
+void poll_scheduler_wait(bool* due){
+    waiting_task = xTaskGetCurrentTaskHandle();
+    while(1){
+        if(!running){
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        int64_t now = esp_timer_get_time();
+        int64_t earliest = INT64_MAX;
+        portENTER_CRITICAL(&states_lock);
+        for(uint16_t id = 0; id < POLL_MAX_POINTS; id++){
+            if(states[id].used && (states[id].next_due < earliest)){
+                earliest = states[id].next_due;
+            }
+        }
+        portEXIT_CRITICAL(&states_lock);
+
+        if(earliest > now){
+            //Sleep until the earliest point is due, start/stop wake us up earlier.
+            int64_t wait_ms = (earliest - now + 999) / 1000;
+            TickType_t ticks = (wait_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+            ulTaskNotifyTake(pdTRUE, ticks > 0 ? ticks : 1);
+            continue;
+        }
+
+        portENTER_CRITICAL(&states_lock);
+        for(uint16_t id = 0; id < POLL_MAX_POINTS; id++){
+            due[id] = states[id].used && (states[id].next_due <= now + POLL_MERGE_WINDOW_US);
+        }
+        portEXIT_CRITICAL(&states_lock);
+        return;
+    }
+}
+
+void poll_scheduler_done(const bool* due){
+    int64_t now = esp_timer_get_time();
+    uint16_t missed = 0;
+    int64_t worst_late = 0;
+    portENTER_CRITICAL(&states_lock);
+    for(uint16_t id = 0; id < POLL_MAX_POINTS; id++){
+        poll_state_t* state = &states[id];
+        if(!state->used || !due[id]){
+            continue;
+        }
+        int64_t late = now - state->next_due;      //Due time to end of the read.
+        if(late > (int64_t)state->deadline_us){
+            state->misses++;
+            missed++;
+            if(late > worst_late){
+                worst_late = late;
+            }
+        }
+        //Keep the phase of the point, but skip the slots that are already in the past.
+        state->next_due += state->period_us;
+        if(state->next_due <= now){
+            state->next_due = now + state->period_us;
+        }
+    }
+    portEXIT_CRITICAL(&states_lock);
+    if(missed){
+        ESP_LOGW(TAG, "Deadline missed by %u points, up to %lld ms late", (unsigned)missed, (long long)(worst_late / 1000));
+    }
+}
+
+uint32_t poll_scheduler_misses(uint16_t id){
+    if(id >= POLL_MAX_POINTS){
+        return 0;
+    }
+    return states[id].misses;
+}
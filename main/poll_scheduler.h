@@ -0,0 +1,54 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _POLL_SCHEDULER_H_
+#define _POLL_SCHEDULER_H_
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include "esp_err.h"
+
+#define POLL_MAX_POINTS     32
+
+/*
+ * One entry of the poll table.
+ * The id is chosen by the caller (a CID, or any other acquisition like the waveform burst).
+ * A point is due every period_ms, and it is counted as a deadline miss when it is served
+ * more than deadline_ms after its due time.
+*/
+typedef struct{
+    uint16_t id;
+    uint32_t period_ms;
+    uint32_t deadline_ms;
+}poll_point_t;
+
+//Set the poll table, ids must be lower than POLL_MAX_POINTS.
+esp_err_t poll_scheduler_init(const poll_point_t* table, uint16_t count);
+
+//Make every point due now and start scheduling (replaces starting the data timer).
+void poll_scheduler_start(void);
+
+//Stop scheduling until poll_scheduler_start() is called again.
+void poll_scheduler_stop(void);
+
+bool poll_scheduler_running(void);
+
+/*
+ * Block the calling task until at least one point is due, then flag in due[] (indexed by id)
+ * every point due now or within the merge window, so they can share bus transactions.
+*/
+void poll_scheduler_wait(bool* due);
+
+//Report that the points flagged in due[] were served, updates their next due time and deadline misses.
+void poll_scheduler_done(const bool* due);
+
+//Number of deadline misses of a point since boot.
+uint32_t poll_scheduler_misses(uint16_t id);
+
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
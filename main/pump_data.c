@@ -0,0 +1,78 @@
+#include "pump_data.h"
+
+const telemetry_field_t pump_data_fields[PUMP_DATA_FIELDS] = {
+    TELEMETRY_BOOL(JSON_DATA_t, pump, "pump", 8, "on", "off"),
+    TELEMETRY_FLOAT(JSON_DATA_t, current, "current", 9, 3, 16),
+    TELEMETRY_FLOAT(JSON_DATA_t, flow_rate, "flow_rate", 10, 3, 16),
+    TELEMETRY_FLOAT(JSON_DATA_t, total_flow, "total_flow", 11, 3, 32),
+    TELEMETRY_BOOL(JSON_DATA_t, anomaly, "status", 12, "Anomaly", "normal"),
+};
+
+size_t sample_to_json(const pump_data_header_t* header, const JSON_DATA_t* sample, char* buf, size_t size){
+    json_writer_t w;
+    json_writer_init(&w, buf, size);
+    json_begin_object(&w);
+    json_key(&w, "boot");
+    json_int(&w, header->boot);
+    json_key(&w, "uptime_ms");
+    json_int(&w, header->uptime_ms);
+    telemetry_write_fields(&w, pump_data_fields, PUMP_DATA_FIELDS, sample);
+    json_end_object(&w);
+    return json_writer_finish(&w);
+}
+
+size_t sample_to_cbor(const pump_data_header_t* header, const JSON_DATA_t* sample, uint8_t* buf, size_t size){
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, size);
+    cbor_map(&w, 3 + PUMP_DATA_FIELDS);
+    cbor_uint(&w, TELEMETRY_KEY_VERSION);
+    cbor_uint(&w, PUBLISH_SCHEMA_VERSION);
+    cbor_uint(&w, CBOR_KEY_BOOT);
+    cbor_uint(&w, header->boot);
+    cbor_uint(&w, CBOR_KEY_UPTIME);
+    cbor_int(&w, header->uptime_ms);
+    telemetry_write_cbor_fields(&w, pump_data_fields, PUMP_DATA_FIELDS, sample);
+    return cbor_writer_finish(&w);
+}
+
+size_t batch_to_json(const pump_data_header_t* header, const JSON_DATA_t* batch, uint16_t count, char* buf, size_t size){
+    json_writer_t w;
+    json_writer_init(&w, buf, size);
+    json_begin_object(&w);
+    json_key(&w, "boot");
+    json_int(&w, header->boot);
+    json_key(&w, "uptime_ms");
+    json_int(&w, header->uptime_ms);
+    json_key(&w, "t0");
+    json_int(&w, batch[0].time_ms);
+    json_key(&w, "dt");
+    json_begin_array(&w);
+    for(uint16_t n = 0; n < count; n++){
+        json_int(&w, batch[n].time_ms - batch[0].time_ms);
+    }
+    json_end_array(&w);
+    telemetry_write_columns(&w, pump_data_fields, PUMP_DATA_FIELDS, batch, sizeof(JSON_DATA_t), count);
+    json_end_object(&w);
+    return json_writer_finish(&w);
+}
+
+size_t batch_to_cbor(const pump_data_header_t* header, const JSON_DATA_t* batch, uint16_t count, uint8_t* buf, size_t size){
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, size);
+    cbor_map(&w, 5 + PUMP_DATA_FIELDS);
+    cbor_uint(&w, TELEMETRY_KEY_VERSION);
+    cbor_uint(&w, PUBLISH_SCHEMA_VERSION);
+    cbor_uint(&w, CBOR_KEY_BOOT);
+    cbor_uint(&w, header->boot);
+    cbor_uint(&w, CBOR_KEY_UPTIME);
+    cbor_int(&w, header->uptime_ms);
+    cbor_uint(&w, CBOR_KEY_T0);
+    cbor_int(&w, batch[0].time_ms);
+    cbor_uint(&w, CBOR_KEY_DT);
+    cbor_array(&w, count);
+    for(uint16_t n = 0; n < count; n++){
+        cbor_int(&w, batch[n].time_ms - batch[0].time_ms);
+    }
+    telemetry_write_cbor_columns(&w, pump_data_fields, PUMP_DATA_FIELDS, batch, sizeof(JSON_DATA_t), count);
+    return cbor_writer_finish(&w);
+}
@@ -0,0 +1,68 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _PUMP_DATA_H_
+#define _PUMP_DATA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include "telemetry.h"
+
+/*
+ * This variabe will be used to queue data needed for json messeges from get_data_from_MODBUS_slave to MQTT_sender
+*/
+typedef struct {
+    bool pump;
+    float current;
+    float flow_rate;
+    float total_flow;
+    bool anomaly;                   //Filled by MQTT_sender from the latest inference.
+    int64_t time_ms;                //esp_timer time (ms) the pump status was read.
+}JSON_DATA_t;
+
+/*
+ * Schema of pump/data, written straight from a JSON_DATA_t: JSON key, CBOR id, then the format.
+ * The total flow grows past the float16 range, it stays float32 in CBOR.
+*/
+#define PUMP_DATA_FIELDS        5
+extern const telemetry_field_t pump_data_fields[PUMP_DATA_FIELDS];
+
+/*
+ * CBOR messages are one map: 0 schema version, then the header (4 boot, 1 uptime_ms, and 2 t0, 3 dt in
+ * a batch) and the field ids above. Bump PUBLISH_SCHEMA_VERSION when an id or a type changes
+ * (tools/cbor_vectors.json, checked by tools/host_checks/cbor_check.c).
+ * Every message carries the boot number and uptime_ms, the time (ms since that boot) it was encoded.
+ * A stored message replayed after a reboot is told apart by its boot number, and placed on the
+ * receiver's clock through the live messages of the same boot (arrival time - uptime_ms).
+*/
+#define PUBLISH_SCHEMA_VERSION  2           //2 added the boot number and uptime_ms of single samples.
+#define CBOR_KEY_UPTIME         1
+#define CBOR_KEY_T0             2
+#define CBOR_KEY_DT             3
+#define CBOR_KEY_BOOT           4
+
+//Header of a message: the boot number and the time since that boot (ms) it is encoded.
+typedef struct{
+    uint32_t boot;
+    int64_t uptime_ms;
+}pump_data_header_t;
+
+/*
+ * Single sample: {"boot":..,"uptime_ms":..,"pump":..,"current":..,"flow_rate":..,"total_flow":..,"status":..}
+ * Batch (columnar): {"boot":..,"uptime_ms":..,"t0":..,"dt":[..],"pump":[..],...}, t0 is the time of the
+ * first sample and dt the offset of each sample from it.
+ * Each returns the length of the message, or 0 if it did not fit in buf.
+*/
+size_t sample_to_json(const pump_data_header_t* header, const JSON_DATA_t* sample, char* buf, size_t size);
+size_t sample_to_cbor(const pump_data_header_t* header, const JSON_DATA_t* sample, uint8_t* buf, size_t size);
+size_t batch_to_json(const pump_data_header_t* header, const JSON_DATA_t* batch, uint16_t count, char* buf, size_t size);
+size_t batch_to_cbor(const pump_data_header_t* header, const JSON_DATA_t* batch, uint16_t count, uint8_t* buf, size_t size);
+
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,371 @@
+#include "store_forward.h"
+#include <stddef.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_log.h"
+
+#define TAG "STORE"
+
+#define STORE_SECTOR_SIZE       4096
+#define STORE_PAGE_SIZE         256
+#define STORE_MAGIC             0x53464c47      //"SFLG"
+#define STORE_STATE_PENDING     0xff            //Erased flash.
+#define STORE_STATE_ACKED       0x00
+#define STORE_LENGTH_FREE       0xffff          //No record here yet.
+#define STORE_ALIGN(n)          (((n) + 3) & ~3u)
+
+//First 16 bytes of every sector.
+typedef struct{
+    uint32_t magic;
+    uint32_t lap;                   //Increases by one every sector started.
+    uint32_t reserved[2];
+}sector_header_t;
+
+typedef struct{
+    uint16_t length;
+    uint8_t state;                  //Cleared in place when the record is acknowledged.
+    uint8_t reserved;
+    uint32_t crc;                   //Of the data.
+}record_header_t;
+
+#define STORE_FIRST_RECORD      sizeof(sector_header_t)
+#define RECORD_SIZE(length)     (sizeof(record_header_t) + STORE_ALIGN(length))
+
+static const esp_partition_t* partition = NULL;
+static uint32_t sector_count = 0;
+static uint32_t head_sector = 0;                //Sector being written.
+static uint32_t head_lap = 0;
+static uint32_t write_offset = 0;               //Partition offset of the next record.
+static uint32_t tail_offset = 0;                //Oldest pending record, write_offset when none.
+static uint32_t peeked_offset = UINT32_MAX;
+static uint32_t pending = 0;
+static uint32_t dropped = 0;
+
+//Staging page: the flash page write_offset is in, page_written bytes of it are already programmed.
+static uint8_t page[STORE_PAGE_SIZE];
+static uint32_t page_addr = 0;
+static uint32_t page_written = 0;
+
+static uint32_t sector_base(uint32_t sector){
+    return sector * STORE_SECTOR_SIZE;
+}
+
+static uint32_t sector_of(uint32_t offset){
+    return offset / STORE_SECTOR_SIZE;
+}
+
+//Offset of the record after the one at offset, a record ending a sector is followed by the next sector's first.
+static uint32_t next_record(uint32_t offset, uint16_t length){
+    offset += RECORD_SIZE(length);
+    if((offset % STORE_SECTOR_SIZE) == 0){
+        offset = sector_base(sector_of(offset) % sector_count) + STORE_FIRST_RECORD;
+    }
+    return offset;
+}
+
+//Program the staged bytes that are not in flash yet.
+static esp_err_t flush_page(void){
+    uint32_t fill = write_offset - page_addr;
+    if(fill <= page_written){
+        return ESP_OK;
+    }
+    esp_err_t err = esp_partition_write(partition, page_addr + page_written, &page[page_written], fill - page_written);
+    if(err != ESP_OK){
+        ESP_LOGE(TAG, "Page write at 0x%" PRIx32 " failed", page_addr);
+        return err;
+    }
+    page_written = fill;
+    return ESP_OK;
+}
+
+static esp_err_t stage(const void* data, uint32_t length){
+    const uint8_t* bytes = (const uint8_t*)data;
+    while(length > 0){
+        uint32_t at = write_offset - page_addr;
+        uint32_t chunk = STORE_PAGE_SIZE - at;
+        if(chunk > length){
+            chunk = length;
+        }
+        memcpy(&page[at], bytes, chunk);
+        write_offset += chunk;
+        bytes += chunk;
+        length -= chunk;
+        if(write_offset - page_addr == STORE_PAGE_SIZE){
+            esp_err_t err = flush_page();
+            if(err != ESP_OK){
+                return err;
+            }
+            page_addr += STORE_PAGE_SIZE;
+            page_written = 0;
+            memset(page, 0xff, sizeof(page));
+        }
+    }
+    return ESP_OK;
+}
+
+//Start staging at offset, the bytes of its page before it are already in flash.
+static esp_err_t load_page(uint32_t offset){
+    page_addr = offset & ~(uint32_t)(STORE_PAGE_SIZE - 1);
+    page_written = offset - page_addr;
+    memset(page, 0xff, sizeof(page));
+    write_offset = offset;
+    return esp_partition_read(partition, page_addr, page, page_written);
+}
+
+static bool read_record_header(uint32_t offset, record_header_t* header){
+    if(offset + sizeof(record_header_t) > sector_base(sector_of(offset)) + STORE_SECTOR_SIZE){
+        return false;
+    }
+    if(esp_partition_read(partition, offset, header, sizeof(*header)) != ESP_OK){
+        return false;
+    }
+    return (header->length != STORE_LENGTH_FREE) && (header->length <= STORE_RECORD_MAX)
+        && (offset + RECORD_SIZE(header->length) <= sector_base(sector_of(offset)) + STORE_SECTOR_SIZE);
+}
+
+static uint32_t count_pending(uint32_t sector, uint32_t* first){
+    uint32_t count = 0;
+    record_header_t header;
+    uint32_t offset = sector_base(sector) + STORE_FIRST_RECORD;
+    while(read_record_header(offset, &header)){
+        if(header.state == STORE_STATE_PENDING){
+            if((count == 0) && (first != NULL)){
+                *first = offset;
+            }
+            count++;
+        }
+        offset += RECORD_SIZE(header.length);
+    }
+    return count;
+}
+
+//Move the writer to the next sector, dropping it first if it still holds pending records.
+static esp_err_t next_sector(void){
+    esp_err_t err = flush_page();
+    if(err != ESP_OK){
+        return err;
+    }
+    uint32_t next = (head_sector + 1) % sector_count;
+    if((pending > 0) && (sector_of(tail_offset) == next)){
+        uint32_t lost = count_pending(next, NULL);
+        dropped += lost;
+        pending -= lost;
+        tail_offset = sector_base((next + 1) % sector_count) + STORE_FIRST_RECORD;
+        peeked_offset = UINT32_MAX;
+        ESP_LOGW(TAG, "Log full, %" PRIu32 " oldest records dropped", lost);
+    }
+    err = esp_partition_erase_range(partition, sector_base(next), STORE_SECTOR_SIZE);
+    if(err != ESP_OK){
+        ESP_LOGE(TAG, "Erase of sector %" PRIu32 " failed", next);
+        return err;
+    }
+    //Magic last, a sector cut by a reset before its lap is complete stays invalid.
+    sector_header_t header = { STORE_MAGIC, head_lap + 1, { 0xffffffff, 0xffffffff } };
+    err = esp_partition_write(partition, sector_base(next) + sizeof(header.magic), &header.lap, sizeof(header) - sizeof(header.magic));
+    if(err == ESP_OK){
+        err = esp_partition_write(partition, sector_base(next), &header.magic, sizeof(header.magic));
+    }
+    if(err != ESP_OK){
+        return err;
+    }
+    head_sector = next;
+    head_lap++;
+    load_page(sector_base(next) + STORE_FIRST_RECORD);
+    if(pending == 0){
+        tail_offset = write_offset;
+    }
+    return ESP_OK;
+}
+
+esp_err_t store_forward_init(void){
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, STORE_PARTITION_LABEL);
+    if(partition == NULL){
+        ESP_LOGE(TAG, "No \"%s\" partition, check partitions.csv", STORE_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    sector_count = partition->size / STORE_SECTOR_SIZE;
+    if(sector_count < 2){
+        return ESP_ERR_INVALID_SIZE;
+    }
+    pending = 0;
+    dropped = 0;
+    peeked_offset = UINT32_MAX;
+
+    //The sector with the highest lap is the one being written.
+    bool found = false;
+    sector_header_t header;
+    for(uint32_t sector = 0; sector < sector_count; sector++){
+        if((esp_partition_read(partition, sector_base(sector), &header, sizeof(header)) == ESP_OK)
+           && (header.magic == STORE_MAGIC) && (!found || (header.lap > head_lap))){
+            head_sector = sector;
+            head_lap = header.lap;
+            found = true;
+        }
+    }
+    if(!found){
+        head_sector = sector_count - 1;         //next_sector() starts the log at sector 0.
+        head_lap = 0;
+        ESP_LOGI(TAG, "Empty log, %" PRIu32 " sectors", sector_count);
+        return next_sector();
+    }
+
+    //End of the written records of the head sector.
+    record_header_t record;
+    uint32_t offset = sector_base(head_sector) + STORE_FIRST_RECORD;
+    while(read_record_header(offset, &record)){
+        offset += RECORD_SIZE(record.length);
+    }
+    esp_err_t err = load_page(offset);
+    if(err != ESP_OK){
+        return err;
+    }
+    if(((offset % STORE_SECTOR_SIZE) != 0) && (esp_partition_read(partition, offset, &record, sizeof(record)) == ESP_OK)
+       && (record.length != STORE_LENGTH_FREE)){
+        //A record cut by a reset, the rest of the sector is not trusted.
+        ESP_LOGW(TAG, "Damaged record at 0x%" PRIx32 ", continuing in the next sector", offset);
+        err = next_sector();
+        if(err != ESP_OK){
+            return err;
+        }
+    }
+
+    //Pending records from the oldest sector on, in ring order after the head.
+    tail_offset = write_offset;
+    for(uint32_t i = 1; i <= sector_count; i++){
+        uint32_t sector = (head_sector + i) % sector_count;
+        if((esp_partition_read(partition, sector_base(sector), &header, sizeof(header)) != ESP_OK)
+           || (header.magic != STORE_MAGIC) || (header.lap > head_lap)){
+            continue;
+        }
+        uint32_t first = 0;
+        uint32_t count = count_pending(sector, &first);
+        if((pending == 0) && (count > 0)){
+            tail_offset = first;
+        }
+        pending += count;
+    }
+    ESP_LOGI(TAG, "%" PRIu32 " records pending, writing sector %" PRIu32 " of %" PRIu32, pending, head_sector, sector_count);
+    return ESP_OK;
+}
+
+esp_err_t store_forward_append(const void* data, uint16_t length){
+    if(partition == NULL){
+        return ESP_ERR_INVALID_STATE;
+    }
+    if((data == NULL) || (length == 0) || (length > STORE_RECORD_MAX)){
+        return ESP_ERR_INVALID_ARG;
+    }
+    if(write_offset + RECORD_SIZE(length) > sector_base(head_sector) + STORE_SECTOR_SIZE){
+        esp_err_t err = next_sector();
+        if(err != ESP_OK){
+            return err;
+        }
+    }
+    if(pending == 0){
+        tail_offset = write_offset;
+    }
+    record_header_t header = { length, STORE_STATE_PENDING, 0xff, esp_rom_crc32_le(0, data, length) };
+    static const uint8_t padding[3] = { 0xff, 0xff, 0xff };
+    esp_err_t err = stage(&header, sizeof(header));
+    if(err == ESP_OK){
+        err = stage(data, length);
+    }
+    if(err == ESP_OK){
+        err = stage(padding, STORE_ALIGN(length) - length);
+    }
+    if(err == ESP_OK){
+        err = flush_page();         //A record must not be lost with the RAM page at a reset.
+    }
+    if(err != ESP_OK){
+        return err;
+    }
+    pending++;
+    return ESP_OK;
+}
+
+uint32_t store_forward_pending(void){
+    return pending;
+}
+
+uint32_t store_forward_dropped(void){
+    return dropped;
+}
+
+esp_err_t store_forward_peek(void* data, uint16_t size, uint16_t* length){
+    if((partition == NULL) || (data == NULL) || (length == NULL)){
+        return ESP_ERR_INVALID_ARG;
+    }
+    while(pending > 0){
+        if(tail_offset + sizeof(record_header_t) > page_addr + page_written){
+            esp_err_t err = flush_page();         //The record is still staged, write what there is.
+            if(err != ESP_OK){
+                return err;
+            }
+        }
+        record_header_t header;
+        bool valid = read_record_header(tail_offset, &header);
+        if(valid && (tail_offset + RECORD_SIZE(header.length) > page_addr + page_written)){
+            esp_err_t err = flush_page();
+            if(err != ESP_OK){
+                return err;
+            }
+        }
+        if(!valid){
+            if(sector_of(tail_offset) == head_sector){
+                ESP_LOGE(TAG, "Lost track of %" PRIu32 " pending records", pending);
+                dropped += pending;
+                pending = 0;
+                tail_offset = write_offset;
+                break;
+            }
+            //End of this sector, go on with the next one.
+            tail_offset = sector_base((sector_of(tail_offset) + 1) % sector_count) + STORE_FIRST_RECORD;
+            continue;
+        }
+        if(header.state != STORE_STATE_PENDING){
+            tail_offset = next_record(tail_offset, header.length);
+            continue;
+        }
+        peeked_offset = tail_offset;                //Acknowledging skips a record that cannot be read.
+        if(header.length > size){
+            return ESP_ERR_INVALID_SIZE;
+        }
+        esp_err_t err = esp_partition_read(partition, tail_offset + sizeof(header), data, header.length);
+        if(err != ESP_OK){
+            return err;
+        }
+        if(esp_rom_crc32_le(0, data, header.length) != header.crc){
+            ESP_LOGW(TAG, "Corrupted record at 0x%" PRIx32 " skipped", tail_offset);
+            dropped++;
+            store_forward_ack();
+            continue;
+        }
+        *length = header.length;
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t store_forward_ack(void){
+    if(peeked_offset != tail_offset){
+        return ESP_ERR_INVALID_STATE;
+    }
+    record_header_t header;
+    if(!read_record_header(peeked_offset, &header)){
+        return ESP_ERR_INVALID_STATE;
+    }
+    //Clearing bits needs no erase, the state byte goes from erased to acknowledged in place.
+    uint8_t state = STORE_STATE_ACKED;
+    esp_err_t err = esp_partition_write(partition, peeked_offset + offsetof(record_header_t, state), &state, 1);
+    if(err != ESP_OK){
+        return err;
+    }
+    peeked_offset = UINT32_MAX;
+    tail_offset = next_record(tail_offset, header.length);
+    pending--;
+    if(pending == 0){
+        tail_offset = write_offset;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,48 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _STORE_FORWARD_H_
+#define _STORE_FORWARD_H_
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include "esp_err.h"
+
+#define STORE_PARTITION_LABEL   "telemetry"     //Data partition of partitions.csv.
+#define STORE_RECORD_MAX        1024            //Largest record, a record never spans two sectors.
+
+/*
+ * Store and forward log of the messages that could not be published.
+ * Append-only ring of records on a dedicated flash partition: each 4 KB sector starts with a
+ * header holding its lap number and is erased only when the ring comes back to it, so every
+ * sector wears the same. Records are gathered in a RAM copy of the current flash page (256 B) and
+ * programmed before store_forward_append() returns, the rest of the page is programmed later in place.
+ * A replayed record is acknowledged by clearing its state byte in place, no erase and no NVS write,
+ * so the log survives a reboot and resumes at the first unacknowledged record.
+ * When the ring is full the oldest sector is dropped.
+ * Not thread safe, used from the MQTT sender task only.
+*/
+esp_err_t store_forward_init(void);
+
+//Append one record (opaque bytes, at most STORE_RECORD_MAX).
+esp_err_t store_forward_append(const void* data, uint16_t length);
+
+//Records appended and not acknowledged yet.
+uint32_t store_forward_pending(void);
+
+//Records lost to a full ring since boot.
+uint32_t store_forward_dropped(void);
+
+//Copy the oldest pending record, ESP_ERR_NOT_FOUND when there is none.
+esp_err_t store_forward_peek(void* data, uint16_t size, uint16_t* length);
+
+//Acknowledge the record returned by the last peek, the next peek returns the one after it.
+esp_err_t store_forward_ack(void);
+
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
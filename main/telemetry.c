@@ -0,0 +1,250 @@
+#include "telemetry.h"
+#include <math.h>
+#include <string.h>
+
+static const uint32_t pow10_table[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+#define TELEMETRY_DECIMALS_MAX  (sizeof(pow10_table) / sizeof(pow10_table[0]) - 1)
+
+static void put(json_writer_t* w, const char* data, size_t len){
+    if(w->len + len < w->size){
+        memcpy(&w->buf[w->len], data, len);
+    }else{
+        w->overflow = true;
+    }
+    w->len += len;
+}
+
+static void put_char(json_writer_t* w, char c){
+    put(w, &c, 1);
+}
+
+//Comma before every value but the first of its object or array, a key counts as the value.
+static void separator(json_writer_t* w){
+    if(!w->first){
+        put_char(w, ',');
+    }
+    w->first = false;
+}
+
+//Digits of value, at least min_digits (zero padded).
+static void put_uint(json_writer_t* w, uint64_t value, int min_digits){
+    char digits[20];
+    int n = 0;
+    do{
+        digits[sizeof(digits) - 1 - n] = '0' + (value % 10);
+        value /= 10;
+        n++;
+    }while((value > 0) || (n < min_digits));
+    put(w, &digits[sizeof(digits) - n], n);
+}
+
+void json_writer_init(json_writer_t* w, char* buf, size_t size){
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->first = true;
+    w->overflow = (size == 0);
+}
+
+size_t json_writer_finish(json_writer_t* w){
+    if(w->overflow || (w->len >= w->size)){
+        if(w->size > 0){
+            w->buf[0] = '\0';
+        }
+        return 0;
+    }
+    w->buf[w->len] = '\0';
+    return w->len;
+}
+
+void json_begin_object(json_writer_t* w){
+    separator(w);
+    put_char(w, '{');
+    w->first = true;
+}
+
+void json_end_object(json_writer_t* w){
+    put_char(w, '}');
+    w->first = false;
+}
+
+void json_begin_array(json_writer_t* w){
+    separator(w);
+    put_char(w, '[');
+    w->first = true;
+}
+
+void json_end_array(json_writer_t* w){
+    put_char(w, ']');
+    w->first = false;
+}
+
+void json_key(json_writer_t* w, const char* key){
+    separator(w);
+    put_char(w, '"');
+    put(w, key, strlen(key));
+    put(w, "\":", 2);
+    w->first = true;                //The value that follows takes no comma.
+}
+
+void json_string(json_writer_t* w, const char* text){
+    separator(w);
+    put_char(w, '"');
+    put(w, text, strlen(text));
+    put_char(w, '"');
+}
+
+void json_bool(json_writer_t* w, bool value){
+    separator(w);
+    if(value){
+        put(w, "true", 4);
+    }else{
+        put(w, "false", 5);
+    }
+}
+
+void json_int(json_writer_t* w, int64_t value){
+    separator(w);
+    if(value < 0){
+        put_char(w, '-');
+        put_uint(w, -(uint64_t)value, 1);
+    }else{
+        put_uint(w, value, 1);
+    }
+}
+
+void json_float(json_writer_t* w, float value, uint8_t decimals){
+    separator(w);
+    if(decimals > TELEMETRY_DECIMALS_MAX){
+        decimals = TELEMETRY_DECIMALS_MAX;
+    }
+    uint32_t scale = pow10_table[decimals];
+    double scaled = fabs((double)value) * scale + 0.5;
+    if(isnan(value) || isinf(value) || (scaled >= 1.8e19)){
+        put(w, "null", 4);
+        return;
+    }
+    uint64_t fixed = (uint64_t)scaled;
+    uint64_t integer = fixed / scale;
+    uint32_t fraction = fixed % scale;
+    if((value < 0.0f) && (fixed != 0)){
+        put_char(w, '-');
+    }
+    put_uint(w, integer, 1);
+    if(fraction != 0){
+        while((fraction % 10) == 0){
+            fraction /= 10;
+            decimals--;
+        }
+        put_char(w, '.');
+        put_uint(w, fraction, decimals);
+    }
+}
+
+static void write_value(json_writer_t* w, const telemetry_field_t* field, const void* record){
+    const void* value = (const uint8_t*)record + field->offset;
+    switch(field->type){
+        case TELEMETRY_FIELD_BOOL:
+            json_string(w, *(const bool*)value ? field->text_true : field->text_false);
+            break;
+        case TELEMETRY_FIELD_FLOAT:
+            json_float(w, *(const float*)value, field->decimals);
+            break;
+        default:
+            separator(w);
+            put(w, "null", 4);
+            break;
+    }
+}
+
+void telemetry_write_fields(json_writer_t* w, const telemetry_field_t* fields, uint16_t count, const void* record){
+    for(uint16_t i = 0; i < count; i++){
+        json_key(w, fields[i].key);
+        write_value(w, &fields[i], record);
+    }
+}
+
+void telemetry_write_columns(json_writer_t* w, const telemetry_field_t* fields, uint16_t count,
+                             const void* records, size_t record_size, uint16_t records_count){
+    for(uint16_t i = 0; i < count; i++){
+        json_key(w, fields[i].key);
+        json_begin_array(w);
+        for(uint16_t n = 0; n < records_count; n++){
+            write_value(w, &fields[i], (const uint8_t*)records + n * record_size);
+        }
+        json_end_array(w);
+    }
+}
+
+static void write_cbor_value(cbor_writer_t* w, const telemetry_field_t* field, const void* record){
+    const void* value = (const uint8_t*)record + field->offset;
+    switch(field->type){
+        case TELEMETRY_FIELD_BOOL:
+            cbor_bool(w, *(const bool*)value);
+            break;
+        case TELEMETRY_FIELD_FLOAT:
+            if(field->bits == 16){
+                cbor_float16(w, *(const float*)value);
+            }else{
+                cbor_float32(w, *(const float*)value);
+            }
+            break;
+        default:
+            cbor_null(w);
+            break;
+    }
+}
+
+void telemetry_write_cbor_fields(cbor_writer_t* w, const telemetry_field_t* fields, uint16_t count, const void* record){
+    for(uint16_t i = 0; i < count; i++){
+        cbor_uint(w, fields[i].id);
+        write_cbor_value(w, &fields[i], record);
+    }
+}
+
+void telemetry_write_cbor_columns(cbor_writer_t* w, const telemetry_field_t* fields, uint16_t count,
+                                  const void* records, size_t record_size, uint16_t records_count){
+    for(uint16_t i = 0; i < count; i++){
+        cbor_uint(w, fields[i].id);
+        cbor_array(w, records_count);
+        for(uint16_t n = 0; n < records_count; n++){
+            write_cbor_value(w, &fields[i], (const uint8_t*)records + n * record_size);
+        }
+    }
+}
+
+static bool outside_deadband(double value, double published, const telemetry_deadband_t* deadband){
+    if(isnan(value) || isnan(published)){
+        return isnan(value) != isnan(published);
+    }
+    double band = fmax(deadband->absolute, fabs(published) * deadband->percent / 100.0);
+    return fabs(value - published) > band;
+}
+
+telemetry_exception_t telemetry_check_deadbands(const telemetry_field_t* fields, const telemetry_deadband_t* deadbands,
+                                                uint16_t count, const void* published, const void* record){
+    telemetry_exception_t exception = TELEMETRY_INSIDE;
+    for(uint16_t i = 0; i < count; i++){
+        const void* value = (const uint8_t*)record + fields[i].offset;
+        const void* last = (const uint8_t*)published + fields[i].offset;
+        bool moved;
+        switch(fields[i].type){
+            case TELEMETRY_FIELD_BOOL:
+                moved = (*(const bool*)value != *(const bool*)last);
+                break;
+            case TELEMETRY_FIELD_FLOAT:
+                moved = outside_deadband(*(const float*)value, *(const float*)last, &deadbands[i]);
+                break;
+            default:
+                moved = false;
+                break;
+        }
+        if(moved && deadbands[i].immediate){
+            return TELEMETRY_IMMEDIATE;
+        }
+        if(moved){
+            exception = TELEMETRY_OUTSIDE;
+        }
+    }
+    return exception;
+}
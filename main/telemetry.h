@@ -0,0 +1,126 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include "cbor.h"
+
+/*
+ * Allocation-free JSON for the telemetry.
+ * A json_writer_t streams values into a caller buffer, nothing is built or allocated in between.
+ * Once the buffer is full the writer only counts, json_writer_finish() then reports the overflow.
+*/
+typedef struct{
+    char* buf;
+    size_t size;
+    size_t len;
+    bool first;                     //No value yet in the current object or array.
+    bool overflow;
+}json_writer_t;
+
+void json_writer_init(json_writer_t* w, char* buf, size_t size);
+//Terminate the string, returns its length or 0 if it did not fit.
+size_t json_writer_finish(json_writer_t* w);
+
+void json_begin_object(json_writer_t* w);
+void json_end_object(json_writer_t* w);
+void json_begin_array(json_writer_t* w);
+void json_end_array(json_writer_t* w);
+//Key of the next value of an object.
+void json_key(json_writer_t* w, const char* key);
+void json_string(json_writer_t* w, const char* text);     //text is not escaped, keep it plain.
+void json_bool(json_writer_t* w, bool value);
+void json_int(json_writer_t* w, int64_t value);
+//Fixed point with at most decimals digits (trailing zeros dropped), null for NaN and infinity.
+void json_float(json_writer_t* w, float value, uint8_t decimals);
+
+/*
+ * Field table of a telemetry record: one entry per field, built at compile time with the macros
+ * below from the record type, so a record is written without any per-field code.
+ * In JSON a field is its key, in CBOR its integer id; ids 0 to 7 are kept for the message header.
+*/
+typedef enum{
+    TELEMETRY_FIELD_BOOL,           //bool, written as one of two strings.
+    TELEMETRY_FIELD_FLOAT,          //float.
+}telemetry_field_type_t;
+
+typedef struct{
+    const char* key;
+    uint8_t id;                     //CBOR key.
+    uint8_t type;                   //telemetry_field_type_t.
+    uint16_t offset;                //offsetof the field in the record.
+    uint8_t decimals;               //FLOAT in JSON.
+    uint8_t bits;                   //FLOAT in CBOR: 16 (half, ~3 significant digits) or 32.
+    const char* text_true;          //BOOL in JSON, CBOR has true and false.
+    const char* text_false;
+}telemetry_field_t;
+
+#define TELEMETRY_HEADER_IDS        8
+
+#define TELEMETRY_BOOL(record, field, key, id, text_true, text_false) \
+    { (key), (id), TELEMETRY_FIELD_BOOL, (uint16_t)offsetof(record, field), 0, 0, (text_true), (text_false) }
+#define TELEMETRY_FLOAT(record, field, key, id, decimals, bits) \
+    { (key), (id), TELEMETRY_FIELD_FLOAT, (uint16_t)offsetof(record, field), (decimals), (bits), NULL, NULL }
+
+//Payload encoding of a topic.
+typedef enum{
+    TELEMETRY_JSON,
+    TELEMETRY_CBOR,
+}telemetry_format_t;
+
+/*
+ * CBOR messages are one map, key 0 holds the schema version so a decoder can tell layouts apart,
+ * the fields follow under their ids. Bump the version whenever an id or a field type changes.
+*/
+#define TELEMETRY_KEY_VERSION       0
+
+/*
+ * Report by exception: a deadband per field of the table, in the same order. A record is worth
+ * publishing once a field moved from the last published record by more than absolute, or than
+ * percent of the published value, whichever is larger. A BOOL field counts on any change.
+ * An immediate field (alarms) asks for the record to go out now instead of with its batch.
+*/
+typedef struct{
+    float absolute;
+    float percent;
+    bool immediate;
+}telemetry_deadband_t;
+
+#define TELEMETRY_DEADBAND(absolute, percent)   { (absolute), (percent), false }
+#define TELEMETRY_ON_CHANGE                     { 0.0f, 0.0f, false }
+#define TELEMETRY_ALARM                         { 0.0f, 0.0f, true }
+
+typedef enum{
+    TELEMETRY_INSIDE,               //Every field inside its deadband.
+    TELEMETRY_OUTSIDE,              //A field left its deadband.
+    TELEMETRY_IMMEDIATE,            //An immediate field changed.
+}telemetry_exception_t;
+
+telemetry_exception_t telemetry_check_deadbands(const telemetry_field_t* fields, const telemetry_deadband_t* deadbands,
+                                                uint16_t count, const void* published, const void* record);
+
+//Write the fields of one record as the members of the current object.
+void telemetry_write_fields(json_writer_t* w, const telemetry_field_t* fields, uint16_t count, const void* record);
+
+/*
+ * Columnar form of records_count records (an array of record_size bytes each): every field becomes
+ * one array with a value per record, so the keys are written once for the whole batch.
+*/
+void telemetry_write_columns(json_writer_t* w, const telemetry_field_t* fields, uint16_t count,
+                             const void* records, size_t record_size, uint16_t records_count);
+
+//CBOR counterparts: id/value pairs of the current map, and one id/array pair per field.
+void telemetry_write_cbor_fields(cbor_writer_t* w, const telemetry_field_t* fields, uint16_t count, const void* record);
+void telemetry_write_cbor_columns(cbor_writer_t* w, const telemetry_field_t* fields, uint16_t count,
+                                  const void* records, size_t record_size, uint16_t records_count);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,171 @@
+#include "vibration_features.h"
+#include <math.h>
+#include <stdlib.h>
+#include "signal/src/circular_buffer.h"
+#include "esp_log.h"
+
+#define TAG "FEATURES"
+
+using tflite::tflm_signal::CircularBuffer;
+
+namespace {
+
+/*
+ * Window of one axis.
+ * The sums of x, x^2 and x^3 are kept exactly in 64-bit integers, x^4 does not fit and is kept
+ * in a double that is rebuilt from the window once per window length, so rounding never piles up.
+ * The peak comes from a queue of decreasing absolute values: each sample goes in and out once.
+*/
+typedef struct{
+  alignas(alignof(CircularBuffer)) uint8_t state[sizeof(CircularBuffer) + 2 * sizeof(int16_t) * VIBRATION_WINDOW_MAX];
+  CircularBuffer* samples;
+  int64_t sum;
+  int64_t sum2;
+  int64_t sum3;
+  double sum4;
+  uint16_t peak_value[VIBRATION_WINDOW_MAX];
+  uint32_t peak_index[VIBRATION_WINDOW_MAX];
+  uint16_t peak_head;
+  uint16_t peak_count;
+}axis_window_t;
+
+axis_window_t windows[VIBRATION_AXES];
+uint16_t window_size = 0;
+uint16_t hop_size = 0;
+float sample_scale = 1.0f;
+uint32_t sample_index = 0;          //Samples added since the reset.
+uint16_t hop_count = 0;             //Samples added since the last vector.
+uint32_t vector_seq = 0;
+
+void axis_reset(axis_window_t* w){
+  tflite::tflm_signal::CircularBufferReset(w->samples);
+  w->sum = 0;
+  w->sum2 = 0;
+  w->sum3 = 0;
+  w->sum4 = 0.0;
+  w->peak_head = 0;
+  w->peak_count = 0;
+}
+
+void axis_resync_sum4(axis_window_t* w){
+  double sum4 = 0.0;
+  size_t count = tflite::tflm_signal::CircularBufferAvailable(w->samples);
+  for(size_t i = 0; i < count; i++){
+    double x = tflite::tflm_signal::CircularBufferPeek(w->samples, i);
+    sum4 += (x * x) * (x * x);
+  }
+  w->sum4 = sum4;
+}
+
+void axis_add(axis_window_t* w, int16_t value){
+  if(tflite::tflm_signal::CircularBufferFull(w->samples)){
+    int64_t old = tflite::tflm_signal::CircularBufferRemove(w->samples);
+    w->sum -= old;
+    w->sum2 -= old * old;
+    w->sum3 -= old * old * old;
+    w->sum4 -= (double)(old * old) * (double)(old * old);
+  }
+  tflite::tflm_signal::CircularBufferAdd(w->samples, value);
+  int64_t x = value;
+  w->sum += x;
+  w->sum2 += x * x;
+  w->sum3 += x * x * x;
+  w->sum4 += (double)(x * x) * (double)(x * x);
+
+  //Drop the smaller peaks from the back, then the ones that left the window from the front.
+  uint16_t magnitude = (uint16_t)abs(value);
+  while(w->peak_count > 0){
+    uint16_t back = (w->peak_head + w->peak_count - 1) % VIBRATION_WINDOW_MAX;
+    if(w->peak_value[back] > magnitude){
+      break;
+    }
+    w->peak_count--;
+  }
+  uint16_t tail = (w->peak_head + w->peak_count) % VIBRATION_WINDOW_MAX;
+  w->peak_value[tail] = magnitude;
+  w->peak_index[tail] = sample_index;
+  w->peak_count++;
+  while(sample_index - w->peak_index[w->peak_head] >= window_size){
+    w->peak_head = (w->peak_head + 1) % VIBRATION_WINDOW_MAX;
+    w->peak_count--;
+  }
+}
+
+void axis_features(const axis_window_t* w, axis_features_t* f){
+  double n = window_size;
+  double mean = w->sum / n;
+  double m2 = w->sum2 / n;
+  double m3 = w->sum3 / n;
+  double m4 = w->sum4 / n;
+  //Central moments from the raw ones.
+  double var = m2 - mean * mean;
+  double c3 = m3 - 3.0 * mean * m2 + 2.0 * mean * mean * mean;
+  double c4 = m4 - 4.0 * mean * m3 + 6.0 * mean * mean * m2 - 3.0 * mean * mean * mean * mean;
+  double rms = sqrt(m2);
+  f->rms = (float)(rms * sample_scale);
+  f->peak = (float)(w->peak_value[w->peak_head] * sample_scale);
+  f->crest = (rms > 0.0) ? (float)(w->peak_value[w->peak_head] / rms) : 0.0f;
+  if(var > 0.0){
+    f->skewness = (float)(c3 / (var * sqrt(var)));
+    f->kurtosis = (float)(c4 / (var * var));
+  }else{
+    f->skewness = 0.0f;
+    f->kurtosis = 0.0f;
+  }
+}
+
+}  // namespace
+
+esp_err_t vibration_features_init(uint16_t window, uint16_t hop, float scale){
+  if((window < 2) || (window > VIBRATION_WINDOW_MAX) || (hop == 0) || (scale <= 0.0f)){
+    ESP_LOGE(TAG, "Wrong window %u / hop %u", (unsigned)window, (unsigned)hop);
+    return ESP_ERR_INVALID_ARG;
+  }
+  window_size = window;
+  hop_size = hop;
+  sample_scale = scale;
+  for(int axis = 0; axis < VIBRATION_AXES; axis++){
+    axis_window_t* w = &windows[axis];
+    w->samples = tflite::tflm_signal::CircularBufferInit(window, w->state,
+                     tflite::tflm_signal::CircularBufferGetNeededMemory(window));
+  }
+  vibration_features_reset();
+  return ESP_OK;
+}
+
+void vibration_features_reset(void){
+  for(int axis = 0; axis < VIBRATION_AXES; axis++){
+    if(windows[axis].samples != nullptr){
+      axis_reset(&windows[axis]);
+    }
+  }
+  sample_index = 0;
+  hop_count = 0;
+}
+
+bool vibration_features_add(const int16_t* sample, vibration_features_t* features){
+  if(window_size == 0){
+    return false;
+  }
+  for(int axis = 0; axis < VIBRATION_AXES; axis++){
+    axis_add(&windows[axis], sample[axis]);
+  }
+  sample_index++;
+  if((sample_index % window_size) == 0){
+    for(int axis = 0; axis < VIBRATION_AXES; axis++){
+      axis_resync_sum4(&windows[axis]);
+    }
+  }
+  if(sample_index < window_size){
+    return false;
+  }
+  if((sample_index > window_size) && (++hop_count < hop_size)){
+    return false;
+  }
+  hop_count = 0;
+  for(int axis = 0; axis < VIBRATION_AXES; axis++){
+    axis_features(&windows[axis], &features->axis[axis]);
+  }
+  features->seq = vector_seq++;
+  return true;
+}
@@ -0,0 +1,48 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _VIBRATION_FEATURES_H_
+#define _VIBRATION_FEATURES_H_
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include "esp_err.h"
+
+#define VIBRATION_AXES          3
+#define VIBRATION_WINDOW_MAX    512         //Longest window, sets the size of the sample buffers.
+
+//Statistics of one axis over the last window of samples.
+typedef struct{
+  float rms;
+  float peak;                   //Largest absolute sample.
+  float crest;                  //peak / rms.
+  float skewness;
+  float kurtosis;               //3 for a gaussian signal.
+}axis_features_t;
+
+typedef struct{
+  axis_features_t axis[VIBRATION_AXES];     //X, Y then Z.
+  uint32_t seq;                 //Feature vector number, increases by one every hop.
+}vibration_features_t;
+
+/*
+ * Streaming feature stage.
+ * Every axis keeps a sliding window of samples with running sums, so a new sample costs the same
+ * whatever the window length, and a feature vector comes out every hop samples once the window is full.
+ * scale converts the raw samples to the unit of rms and peak, the other features have no unit.
+*/
+esp_err_t vibration_features_init(uint16_t window, uint16_t hop, float scale);
+
+//Empty the windows, the next vector comes out once they are full again.
+void vibration_features_reset(void);
+
+//Add one (x, y, z) sample, returns true and fills features when a hop is complete.
+bool vibration_features_add(const int16_t* sample, vibration_features_t* features);
+
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,88 @@
+#include "vibration_spectrum.h"
+#include <math.h>
+#include "signal/src/complex.h"
+#include "signal/src/energy.h"
+#include "signal/src/fft_auto_scale.h"
+#include "signal/src/rfft.h"
+#include "signal/src/window.h"
+#include "esp_log.h"
+
+#define TAG "SPECTRUM"
+
+#define SPECTRUM_BINS           (SPECTRUM_FFT_LENGTH / 2 + 1)
+#define SPECTRUM_WINDOW_SHIFT   14          //Window in Q14.
+#define SPECTRUM_FFT_STATE      1024        //Bytes of FFT state, checked at init.
+
+namespace {
+
+int16_t window[SPECTRUM_FFT_LENGTH];
+alignas(8) uint8_t fft_state[SPECTRUM_FFT_STATE];
+void* fft = nullptr;
+uint16_t band_start[SPECTRUM_BANDS];        //First bin of each band.
+uint16_t band_end[SPECTRUM_BANDS];          //One past the last bin.
+uint32_t spectrum_seq = 0;
+
+//Scratch of one axis.
+int16_t windowed[SPECTRUM_FFT_LENGTH];
+Complex<int16_t> bins[SPECTRUM_BINS];
+uint32_t energy[SPECTRUM_BINS];
+
+}  // namespace
+
+esp_err_t vibration_spectrum_init(float sample_rate_hz, float rotation_hz){
+  if((sample_rate_hz <= 0.0f) || (rotation_hz <= 0.0f)){
+    return ESP_ERR_INVALID_ARG;
+  }
+  size_t needed = tflm_signal::RfftInt16GetNeededMemory(SPECTRUM_FFT_LENGTH);
+  if(needed > sizeof(fft_state)){
+    ESP_LOGE(TAG, "FFT needs %u bytes of state", (unsigned)needed);
+    return ESP_ERR_NO_MEM;
+  }
+  fft = tflm_signal::RfftInt16Init(SPECTRUM_FFT_LENGTH, fft_state, sizeof(fft_state));
+  if(fft == nullptr){
+    return ESP_FAIL;
+  }
+  for(int n = 0; n < SPECTRUM_FFT_LENGTH; n++){
+    float hann = 0.5f * (1.0f - cosf(2.0f * (float)M_PI * n / SPECTRUM_FFT_LENGTH));
+    window[n] = (int16_t)lroundf(hann * ((1 << SPECTRUM_WINDOW_SHIFT) - 1));
+  }
+  float bin_hz = sample_rate_hz / SPECTRUM_FFT_LENGTH;
+  if(rotation_hz < bin_hz){
+    ESP_LOGW(TAG, "Rotation %.1f Hz below the bin width %.1f Hz, bands will be empty", rotation_hz, bin_hz);
+  }
+  for(int h = 0; h < SPECTRUM_BANDS; h++){
+    long start = lroundf((h + 0.5f) * rotation_hz / bin_hz);
+    long end = lroundf((h + 1.5f) * rotation_hz / bin_hz);
+    band_start[h] = (start < SPECTRUM_BINS) ? start : SPECTRUM_BINS;
+    band_end[h] = (end < SPECTRUM_BINS) ? end : SPECTRUM_BINS;
+  }
+  if(band_end[SPECTRUM_BANDS - 1] >= SPECTRUM_BINS){
+    ESP_LOGW(TAG, "Upper harmonics above Nyquist (%.1f Hz), their bands are cut", sample_rate_hz / 2);
+  }
+  return ESP_OK;
+}
+
+esp_err_t vibration_spectrum_compute(const int16_t* const* axis, vibration_spectrum_t* spectrum){
+  if((axis == nullptr) || (spectrum == nullptr)){
+    return ESP_ERR_INVALID_ARG;
+  }
+  if(fft == nullptr){
+    return ESP_ERR_INVALID_STATE;
+  }
+  for(int a = 0; a < VIBRATION_AXES; a++){
+    tflm_signal::ApplyWindow(axis[a], window, SPECTRUM_FFT_LENGTH, SPECTRUM_WINDOW_SHIFT, windowed);
+    //Use the whole int16 range before the fixed point FFT, and take the gain back out of the energies.
+    int scale_bits = tflite::tflm_signal::FftAutoScale(windowed, SPECTRUM_FFT_LENGTH, windowed);
+    tflm_signal::RfftInt16Apply(fft, windowed, bins);
+    tflite::tflm_signal::SpectrumToEnergy(bins, 0, SPECTRUM_BINS, energy);
+    for(int h = 0; h < SPECTRUM_BANDS; h++){
+      uint64_t sum = 0;
+      for(int k = band_start[h]; k < band_end[h]; k++){
+        sum += energy[k];
+      }
+      spectrum->band[a][h] = (sum > 0) ? log2f((float)sum) - 2 * scale_bits : 0.0f;
+    }
+  }
+  spectrum->seq = spectrum_seq++;
+  return ESP_OK;
+}
@@ -0,0 +1,36 @@
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef _VIBRATION_SPECTRUM_H_
+#define _VIBRATION_SPECTRUM_H_
+
+#include <inttypes.h>
+#include "esp_err.h"
+#include "vibration_features.h"
+
+#define SPECTRUM_FFT_LENGTH     128         //One waveform burst per axis.
+#define SPECTRUM_BANDS          8           //Rotation harmonics 1 to 8.
+
+//Band energies of one burst, log2 of the energy so loud and quiet bands fit the same input range.
+typedef struct{
+  float band[VIBRATION_AXES][SPECTRUM_BANDS];
+  uint32_t seq;                 //Burst number, increases by one every computed spectrum.
+}vibration_spectrum_t;
+
+/*
+ * Spectral stage: Hann window, int16 real FFT and bin energies from the signal library,
+ * summed into one band per pump rotation harmonic. Band h covers (h - 0.5) to (h + 0.5) times
+ * the rotation frequency, so a bearing or impeller defect shows up in the band of its harmonic.
+*/
+esp_err_t vibration_spectrum_init(float sample_rate_hz, float rotation_hz);
+
+//Spectrum of one burst of SPECTRUM_FFT_LENGTH samples per axis (X, Y then Z).
+esp_err_t vibration_spectrum_compute(const int16_t* const* axis, vibration_spectrum_t* spectrum);
+
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -253,6 +253,36 @@ esp_err_t mbc_master_get_transaction_info(mb_trans_info_t *ptinfo)
     return ESP_OK;
 }
 
+/**
+ * Helper function to get number of heap allocations of the parameter path
+ */
+esp_err_t mbc_master_get_scratch_alloc_count(uint32_t *count)
+{
+    MB_MASTER_CHECK((count),
+                    ESP_ERR_INVALID_ARG,
+                    "Wrong argument.");
+    MB_MASTER_CHECK((master_interface_ptr != NULL),
+                    ESP_ERR_INVALID_STATE,
+                    "Master interface is not correctly initialized.");
+    *count = master_interface_ptr->opts.mbm_scratch_alloc_count;
+    return ESP_OK;
+}
+
+/**
+ * Set the respond timeout used by the next requests
+ */
+esp_err_t mbc_master_set_response_timeout(uint32_t timeout_ms)
+{
+    MB_MASTER_CHECK(((timeout_ms > 0) && (timeout_ms <= MB_MASTER_TIMEOUT_MS_RESPOND)),
+                    ESP_ERR_INVALID_ARG,
+                    "Wrong timeout %u ms.", (unsigned)timeout_ms);
+    MB_MASTER_CHECK((master_interface_ptr != NULL),
+                    ESP_ERR_INVALID_STATE,
+                    "Master interface is not correctly initialized.");
+    vMBMasterPortTimersSetRespondTimeout((ULONG)timeout_ms);
+    return ESP_OK;
+}
+
 // Helper function to set parameter buffer according to its type
 esp_err_t mbc_master_set_param_data(void* dest, void* src, mb_descr_type_t param_type, size_t param_size)
 {
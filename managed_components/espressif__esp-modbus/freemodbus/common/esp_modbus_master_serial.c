@@ -30,3 +30,11 @@ esp_err_t mbc_master_init(mb_port_type_t port_type, void** handler)
     }
     return error;
 }
+
+/**
+ * Change the baudrate of the started serial master
+ */
+esp_err_t mbc_master_set_baudrate(uint32_t baudrate)
+{
+    return mbc_serial_master_set_baudrate(baudrate);
+}
@@ -6,6 +6,7 @@
 
 #include "esp_err.h"                // for esp_err_t
 #include "esp_timer.h"              // for esp_timer_get_time()
+#include "freertos/semphr.h"        // for the register area mutex
 #include "sdkconfig.h"              // for KConfig defines
 
 #include "mbc_slave.h"              // for slave private type definitions
@@ -14,6 +15,19 @@
 #include "esp_modbus_slave.h"       // for public slave defines
 #include "esp_modbus_callbacks.h"   // for modbus callbacks function pointers declaration
 
+// Guards the register areas while the stack copies them, so the application can update
+// multi-register values without a client reading half of them. A mutex, not a spinlock:
+// a copy of up to 125 registers does not keep interrupts off, and the holder inherits the
+// priority of a waiting stack task. Created with the interface, no locking before that.
+static StaticSemaphore_t mbs_area_mutex_buffer;
+static SemaphoreHandle_t mbs_area_mutex = NULL;
+
+#define MB_SLAVE_AREA_LOCK()    do { if (mbs_area_mutex) { (void)xSemaphoreTake(mbs_area_mutex, portMAX_DELAY); } } while (0)
+#define MB_SLAVE_AREA_UNLOCK()  do { if (mbs_area_mutex) { (void)xSemaphoreGive(mbs_area_mutex); } } while (0)
+
+// When set, writes to holding registers and coils are refused with an illegal data address exception
+static bool mbs_read_only = false;
+
 #ifdef CONFIG_FMB_CONTROLLER_SLAVE_ID_SUPPORT
 
 #define MB_ID_BYTE0(id) ((uint8_t)(id))
@@ -85,6 +99,9 @@ void mbc_slave_init_iface(void* handler)
     LIST_INIT(&mbs_opts->mbs_area_descriptors[MB_PARAM_HOLDING]);
     LIST_INIT(&mbs_opts->mbs_area_descriptors[MB_PARAM_COIL]);
     LIST_INIT(&mbs_opts->mbs_area_descriptors[MB_PARAM_DISCRETE]);
+    if (mbs_area_mutex == NULL) {
+        mbs_area_mutex = xSemaphoreCreateMutexStatic(&mbs_area_mutex_buffer);
+    }
 }
 
 /**
@@ -229,6 +246,30 @@ esp_err_t mbc_slave_set_descriptor(mb_register_area_descriptor_t descr_data)
     return error;
 }
 
+/**
+ * Lock the register areas against stack access
+ */
+void mbc_slave_lock(void)
+{
+    MB_SLAVE_AREA_LOCK();
+}
+
+/**
+ * Unlock the register areas
+ */
+void mbc_slave_unlock(void)
+{
+    MB_SLAVE_AREA_UNLOCK();
+}
+
+/**
+ * Refuse or accept writes of the register areas
+ */
+void mbc_slave_set_read_only(bool read_only)
+{
+    mbs_read_only = read_only;
+}
+
 // The helper function to get time stamp in microseconds
 static uint64_t mbc_slave_get_time_stamp(void)
 {
@@ -300,11 +341,13 @@ eMBErrorCode mbc_reg_input_slave_cb(UCHAR * reg_buffer, USHORT address, USHORT n
         reg_index <<= 1; // register Address to byte address
         input_buffer += reg_index;
         uint8_t* buffer_start = input_buffer;
+        MB_SLAVE_AREA_LOCK();
         while (regs > 0) {
             _XFER_2_RD(reg_buffer, input_buffer);
             reg_index += 2;
             regs -= 1;
         }
+        MB_SLAVE_AREA_UNLOCK();
         // Send access notification
         (void)mbc_slave_send_param_access_notification(MB_EVENT_INPUT_REG_RD);
         // Send parameter info to application task
@@ -338,11 +381,13 @@ eMBErrorCode mbc_reg_holding_slave_cb(UCHAR * reg_buffer, USHORT address, USHORT
         uint8_t* buffer_start = holding_buffer;
         switch (mode) {
             case MB_REG_READ:
+                MB_SLAVE_AREA_LOCK();
                 while (regs > 0) {
                     _XFER_2_RD(reg_buffer, holding_buffer);
                     reg_index += 2;
                     regs -= 1;
                 };
+                MB_SLAVE_AREA_UNLOCK();
                 // Send access notification
                 (void)mbc_slave_send_param_access_notification(MB_EVENT_HOLDING_REG_RD);
                 // Send parameter info
@@ -350,12 +395,18 @@ eMBErrorCode mbc_reg_holding_slave_cb(UCHAR * reg_buffer, USHORT address, USHORT
                                 (uint8_t*)buffer_start, (uint16_t)n_regs);
                 break;
             case MB_REG_WRITE:
+                if (mbs_read_only) {
+                    status = MB_ENOREG;
+                    break;
+                }
+                MB_SLAVE_AREA_LOCK();
                 while (regs > 0) {
                     _XFER_2_WR(holding_buffer, reg_buffer);
                     holding_buffer += 2;
                     reg_index += 2;
                     regs -= 1;
                 };
+                MB_SLAVE_AREA_UNLOCK();
                 // Send access notification
                 (void)mbc_slave_send_param_access_notification(MB_EVENT_HOLDING_REG_WR);
                 // Send parameter info
@@ -388,18 +439,25 @@ eMBErrorCode mbc_reg_coils_slave_cb(UCHAR* reg_buffer, USHORT address, USHORT n_
         CHAR* coils_data_buf = (CHAR*)(reg_coils_buf + (reg_index >> 3));
         switch (mode) {
             case MB_REG_READ:
+                MB_SLAVE_AREA_LOCK();
                 while (coils > 0) {
                     uint8_t result = xMBUtilGetBits((uint8_t*)reg_coils_buf, reg_index, 1);
                     xMBUtilSetBits(reg_buffer, reg_index - (address - reg_coils_start), 1, result);
                     reg_index++;
                     coils--;
                 }
+                MB_SLAVE_AREA_UNLOCK();
                 // Send an event to notify application task about event
                 (void)mbc_slave_send_param_access_notification(MB_EVENT_COILS_RD);
                 (void)mbc_slave_send_param_info(MB_EVENT_COILS_RD, (uint16_t)address,
                                 (uint8_t*)(coils_data_buf), (uint16_t)n_coils);
                 break;
             case MB_REG_WRITE:
+                if (mbs_read_only) {
+                    status = MB_ENOREG;
+                    break;
+                }
+                MB_SLAVE_AREA_LOCK();
                 while (coils > 0) {
                     uint8_t result = xMBUtilGetBits(reg_buffer,
                             reg_index - (address - reg_coils_start), 1);
@@ -407,6 +465,7 @@ eMBErrorCode mbc_reg_coils_slave_cb(UCHAR* reg_buffer, USHORT address, USHORT n_
                     reg_index++;
                     coils--;
                 }
+                MB_SLAVE_AREA_UNLOCK();
                 // Send an event to notify application task about event
                 (void)mbc_slave_send_param_access_notification(MB_EVENT_COILS_WR);
                 (void)mbc_slave_send_param_info(MB_EVENT_COILS_WR, (uint16_t)address,
@@ -443,10 +502,12 @@ eMBErrorCode mbc_reg_discrete_slave_cb(UCHAR* reg_buffer, USHORT address, USHORT
         reg_index = (uint16_t) (address - reg_discrete_start) / 8; // Get register index in the buffer for bit number
         reg_bit_index = (uint16_t)(address - reg_discrete_start) % 8; // Get bit index
         uint8_t* temp_buf = &discrete_input_buf[reg_index];
+        MB_SLAVE_AREA_LOCK();
         while (n_reg > 0) {
             *reg_buffer++ = xMBUtilGetBits(&discrete_input_buf[reg_index++], reg_bit_index, 8);
             n_reg--;
         }
+        MB_SLAVE_AREA_UNLOCK();
         reg_buffer--;
         // Last discrete
         n_discrete = n_discrete % 8;
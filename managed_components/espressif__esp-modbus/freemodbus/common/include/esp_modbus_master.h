@@ -344,6 +344,50 @@ esp_err_t mbc_master_set_param_data(void* dest, void* src, mb_descr_type_t param
 */
 esp_err_t mbc_master_get_transaction_info(mb_trans_info_t *ptinfo);
 
+/**
+ * @brief Get the number of heap allocations done by the get/set parameter path.
+ *        The scratch buffers are normally taken from a static pool, so this counter
+ *        stays constant during steady-state polling.
+ *
+ * @param[out] count the pointer to store the number of allocations
+ *
+ * @return
+ *     - esp_err_t ESP_OK - the counter is saved in the count parameter
+ *     - esp_err_t ESP_ERR_INVALID_ARG - invalid argument of function
+ *     - esp_err_t ESP_ERR_INVALID_STATE - master interface is not initialized
+*/
+esp_err_t mbc_master_get_scratch_alloc_count(uint32_t *count);
+
+/**
+ * @brief Set the slave respond timeout used by the requests sent after this call.
+ *        Allows to poll slow and fast slaves on the same bus, or to give up early
+ *        on a slave that is known to be offline.
+ *
+ * @param[in] timeout_ms respond timeout in milliseconds, up to CONFIG_FMB_MASTER_TIMEOUT_MS_RESPOND
+ *
+ * @return
+ *     - esp_err_t ESP_OK - the timeout is set
+ *     - esp_err_t ESP_ERR_INVALID_ARG - the timeout is zero or above the configured one
+ *     - esp_err_t ESP_ERR_INVALID_STATE - master interface is not initialized
+*/
+esp_err_t mbc_master_set_response_timeout(uint32_t timeout_ms);
+
+/**
+ * @brief Change the baudrate of the started serial master (RTU mode).
+ *        The UART rate and the T3.5 inter-frame timer are updated between two transactions,
+ *        the slaves must already listen at the new rate.
+ *
+ * @param[in] baudrate new line speed
+ *
+ * @return
+ *     - esp_err_t ESP_OK - the baudrate is changed
+ *     - esp_err_t ESP_ERR_INVALID_ARG - invalid baudrate
+ *     - esp_err_t ESP_ERR_NOT_SUPPORTED - the master is not in RTU mode
+ *     - esp_err_t ESP_ERR_TIMEOUT - a transaction did not finish in time
+ *     - esp_err_t ESP_ERR_INVALID_STATE - master interface is not initialized or the change failed
+*/
+esp_err_t mbc_master_set_baudrate(uint32_t baudrate);
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,6 +10,7 @@
 // Public interface header for slave
 #include <stdint.h>                 // for standard int types definition
 #include <stddef.h>                 // for NULL and std defines
+#include <stdbool.h>                // for bool
 #include "soc/soc.h"                // for BITN definitions
 #include "freertos/FreeRTOS.h"      // for task creation and queues access
 #include "freertos/event_groups.h"  // for event groups
@@ -141,6 +142,26 @@ esp_err_t mbc_slave_get_param_info(mb_param_info_t* reg_info, uint32_t timeout);
  */
 esp_err_t mbc_slave_set_descriptor(mb_register_area_descriptor_t descr_data);
 
+/**
+ * @brief Lock the register areas so the stack does not read or write them while
+ *        the application updates values spanning several registers.
+ *        This is a mutex: call it from a task, keep the update short, the stack waits for it.
+ */
+void mbc_slave_lock(void);
+
+/**
+ * @brief Unlock the register areas locked by mbc_slave_lock()
+ */
+void mbc_slave_unlock(void);
+
+/**
+ * @brief Refuse writes to the holding registers and coils with an illegal data address exception,
+ *        for a slave that only publishes values of the application
+ *
+ * @param[in] read_only true to refuse writes, false (default) to accept them
+ */
+void mbc_slave_set_read_only(bool read_only);
+
 #ifdef __cplusplus
 }
 #endif
@@ -66,6 +66,9 @@ typedef struct {
     EventGroupHandle_t mbm_event_group;                 /*!< Modbus controller event group */
     const mb_parameter_descriptor_t* mbm_param_descriptor_table; /*!< Modbus controller parameter description table */
     size_t mbm_param_descriptor_size;                   /*!< Modbus controller parameter description table size*/
+    uint16_t* mbm_param_key_index;                      /*!< Hashed parameter key index, each slot holds (cid + 1) or zero if free */
+    size_t mbm_param_key_index_mask;                    /*!< Number of slots in the key index minus one (power of two) */
+    uint32_t mbm_scratch_alloc_count;                   /*!< Heap allocations done by the get/set parameter path */
 #if MB_MASTER_TCP_ENABLED
     LIST_HEAD(mbm_slave_addr_info_, mb_slave_addr_entry_s) mbm_slave_list; /*!< Slave address information list */
     uint16_t mbm_slave_list_count;
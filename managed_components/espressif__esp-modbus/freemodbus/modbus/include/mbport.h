@@ -164,6 +164,8 @@ BOOL            xMBPortSerialSendResponse( UCHAR *pucMBSerialFrame, USHORT usSer
 BOOL            xMBMasterPortSerialInit( UCHAR ucPort, ULONG ulBaudRate,
                                    UCHAR ucDataBits, eMBParity eParity );
 
+BOOL            xMBMasterPortSerialSetBaudRate( ULONG ulBaudRate );
+
 void            vMBMasterPortClose( void );
 
 void            xMBMasterPortSerialClose( void );
@@ -204,6 +206,10 @@ void            vMBMasterPortTimersConvertDelayEnable( void );
 
 void            vMBMasterPortTimersRespondTimeoutEnable( void );
 
+void            vMBMasterPortTimersSetRespondTimeout( ULONG ulTimeOutMs );
+
+void            vMBMasterPortTimersSetT35( USHORT usTimeOut50us );
+
 void            vMBMasterPortTimersDisable( void );
 
 
@@ -88,6 +88,27 @@ static volatile UCHAR *ucMasterRTURcvBuf = ucMasterRcvBuf;
 static volatile UCHAR *ucMasterRTUSndBuf = ucMasterSndBuf;
 
 /* ----------------------- Start implementation -----------------------------*/
+static USHORT
+usMBMasterRTUTimerT35( ULONG ulBaudRate )
+{
+    /* If baudrate > 19200 then we should use the fixed timer values
+     * t35 = 1750us. Otherwise t35 must be 3.5 times the character time.
+     */
+    if( ulBaudRate > 19200 )
+    {
+        return 35;       /* 1800us. */
+    }
+    /* The timer reload value for a character is given by:
+     *
+     * ChTimeValue = Ticks_per_1s / ( Baudrate / 11 )
+     *             = 11 * Ticks_per_1s / Baudrate
+     *             = 220000 / Baudrate
+     * The reload for t3.5 is 1.5 times this value and similary
+     * for t3.5.
+     */
+    return ( USHORT )( ( 7UL * 220000UL ) / ( 2UL * ulBaudRate ) );
+}
+
 eMBErrorCode
 eMBMasterRTUInit(UCHAR ucPort, ULONG ulBaudRate, eMBParity eParity )
 {
@@ -103,25 +124,7 @@ eMBMasterRTUInit(UCHAR ucPort, ULONG ulBaudRate, eMBParity eParity )
     }
     else
     {
-        /* If baudrate > 19200 then we should use the fixed timer values
-         * t35 = 1750us. Otherwise t35 must be 3.5 times the character time.
-         */
-        if( ulBaudRate > 19200 )
-        {
-            usTimerT35_50us = 35;       /* 1800us. */
-        }
-        else
-        {
-            /* The timer reload value for a character is given by:
-             *
-             * ChTimeValue = Ticks_per_1s / ( Baudrate / 11 )
-             *             = 11 * Ticks_per_1s / Baudrate
-             *             = 220000 / Baudrate
-             * The reload for t3.5 is 1.5 times this value and similary
-             * for t3.5.
-             */
-            usTimerT35_50us = ( 7UL * 220000UL ) / ( 2UL * ulBaudRate );
-        }
+        usTimerT35_50us = usMBMasterRTUTimerT35( ulBaudRate );
         if( xMBMasterPortTimersInit( ( USHORT ) usTimerT35_50us ) != TRUE )
         {
             eStatus = MB_EPORTERR;
@@ -132,6 +135,24 @@ eMBMasterRTUInit(UCHAR ucPort, ULONG ulBaudRate, eMBParity eParity )
     return eStatus;
 }
 
+/* Change the line speed of a started stack, between two transactions.
+ * The inter-frame timer is recomputed for the new character time.
+ */
+eMBErrorCode
+eMBMasterRTUSetBaudRate( ULONG ulBaudRate )
+{
+    if( ulBaudRate == 0 )
+    {
+        return MB_EINVAL;
+    }
+    if( xMBMasterPortSerialSetBaudRate( ulBaudRate ) != TRUE )
+    {
+        return MB_EPORTERR;
+    }
+    vMBMasterPortTimersSetT35( usMBMasterRTUTimerT35( ulBaudRate ) );
+    return MB_ENOERR;
+}
+
 void
 eMBMasterRTUStart( void )
 {
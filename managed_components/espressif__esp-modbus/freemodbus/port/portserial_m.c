@@ -347,6 +347,19 @@ BOOL xMBMasterPortSerialInit( UCHAR ucPORT, ULONG ulBaudRate, UCHAR ucDataBits,
     return TRUE;
 }
 
+BOOL xMBMasterPortSerialSetBaudRate(ULONG ulBaudRate)
+{
+    // Let the last frame leave the line before the bit time changes
+    (void)uart_wait_tx_done(ucUartNumber, MB_SERIAL_TX_TOUT_TICKS);
+    esp_err_t xErr = uart_set_baudrate(ucUartNumber, (uint32_t)ulBaudRate);
+    MB_PORT_CHECK((xErr == ESP_OK), FALSE,
+            "mb set baudrate failure, uart_set_baudrate() returned (0x%x).", (int)xErr);
+    // Bytes received at the old rate are garbage now
+    uart_flush_input(ucUartNumber);
+    ESP_LOGD(MB_PORT_TAG,"%s Baudrate %u.", __func__, (unsigned)ulBaudRate);
+    return TRUE;
+}
+
 void vMBMasterPortSerialClose(void)
 {
     vMBMasterPortRxSemaClose();
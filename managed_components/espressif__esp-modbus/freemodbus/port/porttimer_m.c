@@ -46,6 +46,8 @@ static const char *TAG = "MBM_TIMER";
 
 /* ----------------------- Variables ----------------------------------------*/
 static xTimerContext_t* pxTimerContext = NULL;
+// Respond timeout of the next requests, can be shortened per slave by the application
+static volatile ULONG ulRespondTimeoutMs = MB_MASTER_TIMEOUT_MS_RESPOND;
 
 /* ----------------------- Start implementation -----------------------------*/
 static void IRAM_ATTR vTimerAlarmCBHandler(void *param)
@@ -122,13 +124,26 @@ void vMBMasterPortTimersConvertDelayEnable(void)
 
 void vMBMasterPortTimersRespondTimeoutEnable(void)
 {
-    uint64_t xToutUs = (MB_MASTER_TIMEOUT_MS_RESPOND * 1000);
+    uint64_t xToutUs = ((uint64_t)ulRespondTimeoutMs * 1000);
 
     vMBMasterSetCurTimerMode(MB_TMODE_RESPOND_TIMEOUT);
     ESP_LOGD(MB_PORT_TAG,"%s Respond enable timeout.", __func__);
     (void)xMBMasterPortTimersEnable(xToutUs);
 }
 
+void vMBMasterPortTimersSetRespondTimeout(ULONG ulTimeOutMs)
+{
+    ulRespondTimeoutMs = ulTimeOutMs;
+}
+
+void vMBMasterPortTimersSetT35(USHORT usTimeOut50us)
+{
+    if (pxTimerContext && (usTimeOut50us > 0)) {
+        // Used from the next T35 period on
+        pxTimerContext->usT35Ticks = usTimeOut50us;
+    }
+}
+
 void MB_PORT_ISR_ATTR
 vMBMasterPortTimersDisable()
 {
@@ -17,6 +17,7 @@
 #include "mb_m.h"                   // for modbus stack master types definition
 #include "port.h"                   // for port callback functions
 #include "mbutils.h"                // for mbutils functions definition for stack callback
+#include "mbrtu.h"                  // for RTU line speed change
 #include "sdkconfig.h"              // for KConfig values
 #include "esp_modbus_common.h"      // for common types
 #include "esp_modbus_master.h"      // for public master types
@@ -33,6 +34,35 @@ extern BOOL xMBMasterPortSerialTxPoll(void);
 static mb_master_interface_t* mbm_interface_ptr = NULL;
 static const char *TAG = "MB_CONTROLLER_MASTER";
 
+// Scratch buffers for the get/set parameter path, taken from static size classes
+// so that steady-state polling does not allocate from the heap.
+#define MB_SCRATCH_SLOTS            (2)     // Buffers per size class (concurrent requests)
+#define MB_SCRATCH_SIZE_SMALL       (16)
+#define MB_SCRATCH_SIZE_MEDIUM      (64)
+#define MB_SCRATCH_SIZE_LARGE       (256)   // Largest register request (125 registers)
+
+typedef struct {
+    uint16_t size;
+    bool busy;
+    uint8_t* buffer;
+} mb_scratch_slot_t;
+
+static uint8_t mb_scratch_small[MB_SCRATCH_SLOTS][MB_SCRATCH_SIZE_SMALL] __attribute__((aligned(4)));
+static uint8_t mb_scratch_medium[MB_SCRATCH_SLOTS][MB_SCRATCH_SIZE_MEDIUM] __attribute__((aligned(4)));
+static uint8_t mb_scratch_large[MB_SCRATCH_SLOTS][MB_SCRATCH_SIZE_LARGE] __attribute__((aligned(4)));
+
+// Ordered by size, the first free slot that fits is the tightest one
+static mb_scratch_slot_t mb_scratch_slots[] = {
+    { MB_SCRATCH_SIZE_SMALL, false, mb_scratch_small[0] },
+    { MB_SCRATCH_SIZE_SMALL, false, mb_scratch_small[1] },
+    { MB_SCRATCH_SIZE_MEDIUM, false, mb_scratch_medium[0] },
+    { MB_SCRATCH_SIZE_MEDIUM, false, mb_scratch_medium[1] },
+    { MB_SCRATCH_SIZE_LARGE, false, mb_scratch_large[0] },
+    { MB_SCRATCH_SIZE_LARGE, false, mb_scratch_large[1] }
+};
+
+#define MB_SCRATCH_SLOT_COUNT (sizeof(mb_scratch_slots) / sizeof(mb_scratch_slots[0]))
+
 // Modbus event processing task
 static void modbus_master_task(void *pvParameters)
 {
@@ -81,6 +111,31 @@ static esp_err_t mbc_serial_master_setup(void* comm_info)
     return ESP_OK;
 }
 
+// Change the baudrate of the started RTU stack between two transactions
+esp_err_t mbc_serial_master_set_baudrate(uint32_t baudrate)
+{
+    MB_MASTER_CHECK((mbm_interface_ptr != NULL),
+                    ESP_ERR_INVALID_STATE,
+                    "Master interface uninitialized.");
+    mb_master_options_t* mbm_opts = &mbm_interface_ptr->opts;
+    MB_MASTER_CHECK((mbm_opts->mbm_comm.mode == MB_MODE_RTU),
+                    ESP_ERR_NOT_SUPPORTED, "mb baudrate change is supported in RTU mode only.");
+    MB_MASTER_CHECK((baudrate > 0), ESP_ERR_INVALID_ARG, "mb incorrect baudrate.");
+    // Hold the stack resource, so no transaction is in progress on the line
+    if (!xMBMasterRunResTake(MB_SERIAL_API_RESP_TICS)) {
+        ESP_LOGE(TAG, "%s: stack is busy.", __FUNCTION__);
+        return ESP_ERR_TIMEOUT;
+    }
+    eMBErrorCode mb_error = eMBMasterRTUSetBaudRate((ULONG)baudrate);
+    if (mb_error == MB_ENOERR) {
+        mbm_opts->mbm_comm.baudrate = baudrate;
+    }
+    vMBMasterRunResRelease();
+    MB_MASTER_CHECK((mb_error == MB_ENOERR), ESP_ERR_INVALID_STATE,
+                    "mb set baudrate failure, returned (0x%x).", (int)mb_error);
+    return ESP_OK;
+}
+
 // Modbus controller stack start function
 static esp_err_t mbc_serial_master_start(void)
 {
@@ -130,12 +185,41 @@ static esp_err_t mbc_serial_master_destroy(void)
     mb_error = eMBMasterClose();
     MB_MASTER_CHECK((mb_error == MB_ENOERR), ESP_ERR_INVALID_STATE,
                     "mb stack close failure returned (0x%x).", (int)mb_error);
+    free(mbm_opts->mbm_param_key_index);
     free(mbm_interface_ptr); // free the memory allocated for options
     vMBPortSetMode((UCHAR)MB_PORT_INACTIVE);
     mbm_interface_ptr = NULL;
     return ESP_OK;
 }
 
+// Hash of the parameter key used by the key index (FNV-1a)
+static uint32_t mbc_serial_master_key_hash(const char* key)
+{
+    uint32_t hash = 2166136261UL;
+    while (*key) {
+        hash ^= (uint8_t)*key++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+// Find the parameter description by its key using the hashed key index
+static const mb_parameter_descriptor_t* mbc_serial_master_find_key(const mb_master_options_t* mbm_opts, const char* name)
+{
+    size_t mask = mbm_opts->mbm_param_key_index_mask;
+    size_t slot = mbc_serial_master_key_hash(name) & mask;
+    uint16_t entry = 0;
+    // The index is at most half full, so the probe always ends on a free slot
+    while ((entry = mbm_opts->mbm_param_key_index[slot]) != 0) {
+        const mb_parameter_descriptor_t* reg_ptr = &mbm_opts->mbm_param_descriptor_table[entry - 1];
+        if (strcmp(name, (const char*)reg_ptr->param_key) == 0) {
+            return reg_ptr;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
 // Set Modbus parameter description table
 static esp_err_t mbc_serial_master_set_descriptor(const mb_parameter_descriptor_t* descriptor, const uint16_t num_elements)
 {
@@ -156,6 +240,33 @@ static esp_err_t mbc_serial_master_set_descriptor(const mb_parameter_descriptor_
         MB_MASTER_CHECK((reg_ptr->mb_size > 0),
                             ESP_ERR_INVALID_ARG, "mb descriptor param size is incorrect.");
     }
+    // Build the key index once, so requests do not have to scan the table.
+    // The cid is already the position in the table, so cid lookups need no index.
+    size_t index_size = 1;
+    while (index_size < ((size_t)num_elements << 1)) {
+        index_size <<= 1;
+    }
+    uint16_t* key_index = calloc(index_size, sizeof(uint16_t));
+    MB_MASTER_CHECK((key_index != NULL),
+                        ESP_ERR_NO_MEM, "mb key index allocation failure.");
+    reg_ptr = descriptor;
+    for (uint16_t counter = 0; counter < (num_elements); counter++, reg_ptr++)
+    {
+        size_t slot = mbc_serial_master_key_hash(reg_ptr->param_key) & (index_size - 1);
+        while (key_index[slot] != 0) {
+            // Keep the first record for duplicated keys as the table scan did
+            if (strcmp(reg_ptr->param_key, descriptor[key_index[slot] - 1].param_key) == 0) {
+                break;
+            }
+            slot = (slot + 1) & (index_size - 1);
+        }
+        if (key_index[slot] == 0) {
+            key_index[slot] = counter + 1;
+        }
+    }
+    free(mbm_opts->mbm_param_key_index);
+    mbm_opts->mbm_param_key_index = key_index;
+    mbm_opts->mbm_param_key_index_mask = index_size - 1;
     mbm_opts->mbm_param_descriptor_table = descriptor;
     mbm_opts->mbm_param_descriptor_size = num_elements;
     return ESP_OK;
@@ -328,7 +439,7 @@ static uint8_t mbc_serial_master_get_command(mb_param_type_t param_type, mb_para
     return command;
 }
 
-// Helper to search parameter by name in the parameter description table
+// Helper to find parameter by name using the key index of the description table
 // and fills Modbus request fields accordingly
 static esp_err_t mbc_serial_master_set_request(char* name, mb_param_mode_t mode,
                                                 mb_param_request_t* request,
@@ -346,40 +457,69 @@ static esp_err_t mbc_serial_master_set_request(char* name, mb_param_mode_t mode,
     MB_MASTER_CHECK((mode <= MB_PARAM_WRITE),
                         ESP_ERR_INVALID_ARG, "mb incorrect mode.");
     MB_MASTER_ASSERT(mbm_opts->mbm_param_descriptor_table != NULL);
-    const mb_parameter_descriptor_t* reg_ptr = mbm_opts->mbm_param_descriptor_table;
-    for (uint16_t counter = 0; counter < (mbm_opts->mbm_param_descriptor_size); counter++, reg_ptr++)
-    {
-        // Check the cid of the parameter is equal to record number in the table
-        // Check the length of name and parameter key strings from table
-        size_t param_key_len = strlen((const char*)reg_ptr->param_key);
-        if (param_key_len != strlen((const char*)name)) {
-            continue; // The length of strings is different then check next record in the table
+    MB_MASTER_ASSERT(mbm_opts->mbm_param_key_index != NULL);
+    const mb_parameter_descriptor_t* reg_ptr = mbc_serial_master_find_key(mbm_opts, name);
+    if (reg_ptr != NULL) {
+        // Returns an error in case of broadcast read request
+        if (!reg_ptr->mb_slave_addr && (mode == MB_PARAM_READ)) {
+            return ESP_ERR_INVALID_ARG;
         }
-        // Compare the name of parameter with parameter key from table
-        int comp_result = memcmp((const void*)name, (const void*)reg_ptr->param_key, (size_t)param_key_len);
-        if (comp_result == 0) {
-            // Returns an error in case of broadcast read request
-            if (!reg_ptr->mb_slave_addr && (mode == MB_PARAM_READ)) {
-                error = ESP_ERR_INVALID_ARG;
-                break;
-            }
-            // The correct line is found in the table and reg_ptr points to the found parameter description
-            request->slave_addr = reg_ptr->mb_slave_addr;
-            request->reg_start = reg_ptr->mb_reg_start;
-            request->reg_size = reg_ptr->mb_size;
-            request->command = mbc_serial_master_get_command(reg_ptr->mb_param_type, mode);
-            MB_MASTER_CHECK((request->command > 0), ESP_ERR_INVALID_ARG,
-                                "mb incorrect command or parameter type.");
-            if (reg_data != NULL) {
-                *reg_data = *reg_ptr; // Set the cid registered parameter data
-            }
-            error = ESP_OK;
-            break;
+        // The correct line is found in the table and reg_ptr points to the found parameter description
+        request->slave_addr = reg_ptr->mb_slave_addr;
+        request->reg_start = reg_ptr->mb_reg_start;
+        request->reg_size = reg_ptr->mb_size;
+        request->command = mbc_serial_master_get_command(reg_ptr->mb_param_type, mode);
+        MB_MASTER_CHECK((request->command > 0), ESP_ERR_INVALID_ARG,
+                            "mb incorrect command or parameter type.");
+        if (reg_data != NULL) {
+            *reg_data = *reg_ptr; // Set the cid registered parameter data
         }
+        error = ESP_OK;
     }
     return error;
 }
 
+// Take a zeroed scratch buffer from the pool, falls back to the heap when the pool is exhausted
+static uint8_t* mbc_serial_master_scratch_take(size_t size)
+{
+    uint8_t* buffer = NULL;
+    ENTER_CRITICAL_SECTION();
+    for (size_t i = 0; i < MB_SCRATCH_SLOT_COUNT; i++) {
+        if (!mb_scratch_slots[i].busy && (size <= mb_scratch_slots[i].size)) {
+            mb_scratch_slots[i].busy = true;
+            buffer = mb_scratch_slots[i].buffer;
+            break;
+        }
+    }
+    EXIT_CRITICAL_SECTION();
+    if (buffer) {
+        memset(buffer, 0, size);
+        return buffer;
+    }
+    buffer = calloc(1, size);
+    if (buffer) {
+        ENTER_CRITICAL_SECTION();
+        mbm_interface_ptr->opts.mbm_scratch_alloc_count++;
+        EXIT_CRITICAL_SECTION();
+        ESP_LOGD(TAG, "%s: scratch pool exhausted, allocated %u bytes.", __FUNCTION__, (unsigned)size);
+    }
+    return buffer;
+}
+
+// Return the scratch buffer to the pool or to the heap
+static void mbc_serial_master_scratch_give(uint8_t* buffer)
+{
+    for (size_t i = 0; i < MB_SCRATCH_SLOT_COUNT; i++) {
+        if (mb_scratch_slots[i].buffer == buffer) {
+            ENTER_CRITICAL_SECTION();
+            mb_scratch_slots[i].busy = false;
+            EXIT_CRITICAL_SECTION();
+            return;
+        }
+    }
+    free(buffer);
+}
+
 static esp_err_t mbc_serial_master_get_parameter(uint16_t cid, char* name, uint8_t* value, uint8_t *type)
 {
     MB_MASTER_CHECK((name != NULL), ESP_ERR_INVALID_ARG, "mb incorrect descriptor.");
@@ -395,8 +535,8 @@ static esp_err_t mbc_serial_master_get_parameter(uint16_t cid, char* name, uint8
         MB_MASTER_CHECK(((reg_info.mb_size << 1) >= reg_info.param_size),
                             MB_EILLSTATE,
                             "Incorrect characteristic data.");
-        // alloc buffer to store parameter data
-        pdata = calloc(1, (reg_info.mb_size << 1));
+        // take buffer to store parameter data
+        pdata = mbc_serial_master_scratch_take(reg_info.mb_size << 1);
         if (!pdata) {
             return ESP_ERR_INVALID_STATE;
         }
@@ -418,7 +558,7 @@ static esp_err_t mbc_serial_master_get_parameter(uint16_t cid, char* name, uint8
             ESP_LOGD(TAG, "%s: Bad response to get cid(%u) = %s",
                      __FUNCTION__, (unsigned)reg_info.cid, (char*)esp_err_to_name(error));
         }
-        free(pdata);
+        mbc_serial_master_scratch_give(pdata);
         // Set the type of parameter found in the table
         *type = reg_info.param_type;
     } else {
@@ -446,7 +586,7 @@ static esp_err_t mbc_serial_master_set_parameter(uint16_t cid, char* name, uint8
         MB_MASTER_CHECK(((reg_info.mb_size << 1) >= reg_info.param_size),
                     MB_EILLSTATE,
                     "Incorrect characteristic data.");
-        pdata = calloc(1, (reg_info.mb_size << 1)); // alloc parameter buffer
+        pdata = mbc_serial_master_scratch_take(reg_info.mb_size << 1); // take parameter buffer
         if (!pdata) {
             return ESP_ERR_INVALID_STATE;
         }
@@ -455,7 +595,7 @@ static esp_err_t mbc_serial_master_set_parameter(uint16_t cid, char* name, uint8
                                               reg_info.param_type, reg_info.param_size);
         if (error != ESP_OK) {
             ESP_LOGE(TAG, "fail to set parameter data.");
-            free(pdata);
+            mbc_serial_master_scratch_give(pdata);
             return ESP_ERR_INVALID_STATE;
         }
         // Send request to write characteristic data
@@ -469,7 +609,7 @@ static esp_err_t mbc_serial_master_set_parameter(uint16_t cid, char* name, uint8
         }
         // Set the type of parameter found in the table
         *type = reg_info.param_type;
-        free(pdata);
+        mbc_serial_master_scratch_give(pdata);
     } else {
         ESP_LOGE(TAG, "%s: The requested cid(%u) is not configured correctly. Check data dictionary for correctness.",
                                     __FUNCTION__, (unsigned)cid);
@@ -684,6 +824,11 @@ esp_err_t mbc_serial_master_create(void** handler)
     // Initialize interface properties
     mb_master_options_t* mbm_opts = &mbm_interface_ptr->opts;
     mbm_opts->port_type = MB_PORT_SERIAL_MASTER;
+    mbm_opts->mbm_param_descriptor_table = NULL;
+    mbm_opts->mbm_param_descriptor_size = 0;
+    mbm_opts->mbm_param_key_index = NULL;
+    mbm_opts->mbm_param_key_index_mask = 0;
+    mbm_opts->mbm_scratch_alloc_count = 0;
 
     vMBPortSetMode((UCHAR)MB_PORT_SERIAL_MASTER);
 
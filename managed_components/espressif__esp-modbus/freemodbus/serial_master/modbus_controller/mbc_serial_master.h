@@ -25,4 +25,16 @@
  */
 esp_err_t mbc_serial_master_create(void** handler);
 
+/**
+ * @brief Change the baudrate of the started RTU master, T3.5 timing follows the new rate
+ *
+ * @param[in] baudrate new line speed
+ * @return
+ *     - ESP_OK   Success
+ *     - ESP_ERR_NOT_SUPPORTED the master is not in RTU mode
+ *     - ESP_ERR_TIMEOUT a transaction is still in progress
+ *     - ESP_ERR_INVALID_STATE the stack or the UART failed to change the rate
+ */
+esp_err_t mbc_serial_master_set_baudrate(uint32_t baudrate);
+
 #endif // _MODBUS_SERIAL_CONTROLLER_MASTER
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Decode the CBOR telemetry of the gateway (pump/data/cbor, pump/data/batch/cbor).
+
+    python3 tools/cbor_decode.py a6000108f509f94a2c...      # hex payload
+    python3 tools/cbor_decode.py --file payload.bin
+    python3 tools/cbor_decode.py --check tools/cbor_vectors.json
+
+Messages are one map whose key 0 is the schema version, the other integer keys
+are named with the table of that version. --check decodes every test vector
+and compares it with its expected JSON, a decoder in another language can use
+the same file.
+"""
+
+import json
+import math
+import struct
+import sys
+
+# Integer keys of each schema version (PUBLISH_SCHEMA_VERSION in main/pump_data.h).
+SCHEMAS = {
+    1: {0: "version", 1: "uptime_ms", 2: "t0", 3: "dt",
+        8: "pump", 9: "current", 10: "flow_rate", 11: "total_flow", 12: "anomaly"},
+    2: {0: "version", 1: "uptime_ms", 2: "t0", 3: "dt", 4: "boot",
+        8: "pump", 9: "current", 10: "flow_rate", 11: "total_flow", 12: "anomaly"},
+}
+
+
+class Decoder:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def take(self, count):
+        if self.pos + count > len(self.data):
+            raise ValueError("truncated payload")
+        chunk = self.data[self.pos:self.pos + count]
+        self.pos += count
+        return chunk
+
+    def argument(self, info):
+        if info < 24:
+            return info
+        if info > 27:
+            raise ValueError("indefinite lengths are not used by the gateway")
+        size = 1 << (info - 24)
+        return int.from_bytes(self.take(size), "big")
+
+    def item(self):
+        initial = self.take(1)[0]
+        major, info = initial >> 5, initial & 0x1f
+        if major == 7:
+            if info == 20:
+                return False
+            if info == 21:
+                return True
+            if info == 22:
+                return None
+            if info == 25:
+                return struct.unpack(">e", self.take(2))[0]
+            if info == 26:
+                return struct.unpack(">f", self.take(4))[0]
+            if info == 27:
+                return struct.unpack(">d", self.take(8))[0]
+            raise ValueError("unknown simple value %d" % info)
+        value = self.argument(info)
+        if major == 0:
+            return value
+        if major == 1:
+            return -1 - value
+        if major == 2:
+            return self.take(value).hex()
+        if major == 3:
+            return self.take(value).decode()
+        if major == 4:
+            return [self.item() for _ in range(value)]
+        if major == 5:
+            return dict((self.item(), self.item()) for _ in range(value))
+        raise ValueError("tags are not used by the gateway")
+
+
+def decode(data):
+    decoder = Decoder(data)
+    message = decoder.item()
+    if decoder.pos != len(data):
+        raise ValueError("%d bytes after the message" % (len(data) - decoder.pos))
+    if not isinstance(message, dict) or 0 not in message:
+        raise ValueError("not a versioned telemetry map")
+    names = SCHEMAS.get(message[0])
+    if names is None:
+        raise ValueError("unknown schema version %r" % message[0])
+    return dict((names.get(key, str(key)), value) for key, value in message.items())
+
+
+def same(a, b):
+    if isinstance(a, float) or isinstance(b, float):
+        return (a is not None) and (b is not None) and math.isclose(a, b, rel_tol=0, abs_tol=0)
+    if isinstance(a, list) and isinstance(b, list):
+        return (len(a) == len(b)) and all(same(x, y) for x, y in zip(a, b))
+    if isinstance(a, dict) and isinstance(b, dict):
+        return (a.keys() == b.keys()) and all(same(a[k], b[k]) for k in a)
+    return a == b
+
+
+def check(path):
+    vectors = json.load(open(path))["vectors"]
+    failed = 0
+    for vector in vectors:
+        try:
+            decoded = decode(bytes.fromhex(vector["cbor"]))
+            ok = same(decoded, vector["decoded"])
+        except ValueError as error:
+            decoded, ok = str(error), False
+        if not ok:
+            failed += 1
+            print("FAIL %s: %s" % (vector["name"], decoded))
+    print("%d of %d vectors decoded as expected" % (len(vectors) - failed, len(vectors)))
+    return failed == 0
+
+
+def main():
+    if len(sys.argv) == 3 and sys.argv[1] == "--check":
+        sys.exit(0 if check(sys.argv[2]) else 1)
+    if len(sys.argv) == 3 and sys.argv[1] == "--file":
+        data = open(sys.argv[2], "rb").read()
+    elif len(sys.argv) == 2:
+        data = bytes.fromhex(sys.argv[1])
+    else:
+        sys.exit(__doc__)
+    print(json.dumps(decode(data)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""Generate the constexpr dense network of main/dense_engine.h from a TFLite model.
+
+Takes the float model, either the .tflite file or the xxd array (main/model.cc),
+and writes a header with one dense::Layer per FullyConnected op. An activation op
+that follows a FullyConnected without a fused one is folded into it.
+
+    python3 tools/dense_codegen.py main/model.cc main/model_dense.h
+
+Rerun it every time model.cc is regenerated, the firmware falls back to the
+interpreter when the hash of the linked model does not match the header.
+"""
+
+import re
+import struct
+import sys
+
+# tflite::BuiltinOperator
+FULLY_CONNECTED = 9
+LOGISTIC = 14
+RELU = 19
+RELU6 = 21
+TANH = 28
+# tflite::ActivationFunctionType
+FUSED = {0: "kNone", 1: "kRelu", 3: "kRelu6", 4: "kTanh"}
+STANDALONE = {LOGISTIC: "kLogistic", RELU: "kRelu", RELU6: "kRelu6", TANH: "kTanh"}
+FLOAT32 = 0
+
+
+class Table:
+    """Just enough of a flatbuffer reader for the tflite schema."""
+
+    def __init__(self, buf, pos):
+        self.buf = buf
+        self.pos = pos
+        vtable = pos - struct.unpack_from("<i", buf, pos)[0]
+        size = struct.unpack_from("<H", buf, vtable)[0]
+        self.fields = [struct.unpack_from("<H", buf, vtable + 4 + 2 * i)[0]
+                       for i in range((size - 4) // 2)]
+
+    def _offset(self, field):
+        if field < len(self.fields) and self.fields[field]:
+            return self.pos + self.fields[field]
+        return None
+
+    def scalar(self, field, fmt, default=0):
+        at = self._offset(field)
+        return default if at is None else struct.unpack_from("<" + fmt, self.buf, at)[0]
+
+    def _indirect(self, field):
+        at = self._offset(field)
+        return None if at is None else at + struct.unpack_from("<I", self.buf, at)[0]
+
+    def table(self, field):
+        at = self._indirect(field)
+        return None if at is None else Table(self.buf, at)
+
+    def vector(self, field, fmt):
+        at = self._indirect(field)
+        if at is None:
+            return []
+        count = struct.unpack_from("<I", self.buf, at)[0]
+        return list(struct.unpack_from("<%d%s" % (count, fmt), self.buf, at + 4))
+
+    def tables(self, field):
+        at = self._indirect(field)
+        if at is None:
+            return []
+        count = struct.unpack_from("<I", self.buf, at)[0]
+        items = []
+        for i in range(count):
+            item = at + 4 + 4 * i
+            items.append(Table(self.buf, item + struct.unpack_from("<I", self.buf, item)[0]))
+        return items
+
+    def bytes(self, field):
+        at = self._indirect(field)
+        if at is None:
+            return b""
+        count = struct.unpack_from("<I", self.buf, at)[0]
+        return self.buf[at + 4:at + 4 + count]
+
+
+def load(path):
+    data = open(path, "rb").read()
+    if path.endswith((".cc", ".c", ".h")):
+        text = data.decode()
+        body = text[text.index("{", text.index("g_model")) + 1:]
+        body = body[:body.index("}")]
+        data = bytes(int(value, 16) for value in re.findall(r"0x[0-9a-fA-F]{2}", body))
+        # The firmware hashes g_model_len bytes, the array may be longer.
+        length = re.search(r"g_model_len\s*=\s*(\d+)", text)
+        if length:
+            data = data[:int(length.group(1))]
+    return data
+
+
+def fnv1a(data):
+    value = 2166136261
+    for byte in data:
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def constant(model, tensors, index):
+    """Float contents of a constant tensor: (shape, values)."""
+    tensor = tensors[index]
+    if tensor.scalar(1, "b") != FLOAT32:
+        sys.exit("tensor %d is not float32, only float models are supported" % index)
+    buffer = model.tables(4)[tensor.scalar(2, "I")]
+    raw = buffer.bytes(0)
+    if not raw and buffer.scalar(1, "Q") > 1:
+        start = buffer.scalar(1, "Q")
+        raw = model.buf[start:start + buffer.scalar(2, "Q")]
+    return tensor.vector(0, "i"), struct.unpack("<%df" % (len(raw) // 4), raw)
+
+
+def layers(data):
+    model = Table(data, struct.unpack_from("<I", data, 0)[0])
+    codes = [max(code.scalar(0, "b"), code.scalar(3, "i")) for code in model.tables(1)]
+    graphs = model.tables(2)
+    if len(graphs) != 1:
+        sys.exit("expected one subgraph, got %d" % len(graphs))
+    tensors = graphs[0].tables(0)
+    result = []
+    for op in graphs[0].tables(3):
+        code = codes[op.scalar(0, "I")]
+        inputs = op.vector(1, "i")
+        if code == FULLY_CONNECTED:
+            options = op.table(4)
+            fused = options.scalar(0, "b") if options else 0
+            if fused not in FUSED:
+                sys.exit("unsupported fused activation %d" % fused)
+            shape, weights = constant(model, tensors, inputs[1])
+            outputs, count = shape
+            if (len(inputs) > 2) and (inputs[2] >= 0):
+                bias = constant(model, tensors, inputs[2])[1]
+            else:
+                bias = [0.0] * outputs
+            rows = [weights[o * count:(o + 1) * count] for o in range(outputs)]
+            result.append({"inputs": count, "outputs": outputs, "activation": FUSED[fused],
+                           "weights": rows, "bias": bias})
+        elif code in STANDALONE:
+            if not result or result[-1]["activation"] != "kNone":
+                sys.exit("activation op %d does not follow a plain FullyConnected" % code)
+            result[-1]["activation"] = STANDALONE[code]
+        else:
+            sys.exit("operator %d is not supported by the dense engine" % code)
+    if not result:
+        sys.exit("no FullyConnected layer in the model")
+    return result
+
+
+def floats(values):
+    """C++ float literals, 9 digits round-trip a float32."""
+    literals = []
+    for value in values:
+        text = "%.9g" % value
+        if not re.search(r"[.e]", text):
+            text += ".0"
+        literals.append(text + "f")
+    return ", ".join(literals)
+
+
+def generate(source, data, network):
+    types = ["Layer<%d, %d, Activation::%s>" % (l["inputs"], l["outputs"], l["activation"])
+             for l in network]
+    lines = [
+        "// Generated by tools/dense_codegen.py from %s, do not edit." % source,
+        "// Layers: %s." % ", ".join("%d->%d %s" % (l["inputs"], l["outputs"], l["activation"][1:])
+                                     for l in network),
+        "",
+        "#ifndef _MODEL_DENSE_H_",
+        "#define _MODEL_DENSE_H_",
+        "",
+        "#include \"dense_engine.h\"",
+        "",
+        "namespace dense {",
+        "",
+        "constexpr int kSourceModelLength = %d;" % len(data),
+        "constexpr uint32_t kSourceModelHash = 0x%08xu;" % fnv1a(data),
+        "",
+        "using Model = Network<",
+    ]
+    lines += ["    %s%s" % (t, "," if i + 1 < len(types) else ">;") for i, t in enumerate(types)]
+    lines.append("")
+    lines.append("constexpr Model kModel = {")
+    for i, layer in enumerate(network):
+        indent = "  " * (i + 1)
+        lines.append("%s{{" % indent)
+        for row in layer["weights"]:
+            lines.append("%s  {%s}," % (indent, floats(row)))
+        lines.append("%s}, {%s}}," % (indent, floats(layer["bias"])))
+        if i + 1 < len(network):
+            lines.append("%s{" % indent)
+    for i in reversed(range(len(network) - 1)):
+        lines.append("%s}," % ("  " * (i + 1)))
+    lines.append("};")
+    lines += ["", "}  // namespace dense", "", "#endif  // _MODEL_DENSE_H_", ""]
+    return "\n".join(lines)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: dense_codegen.py <model.tflite|model.cc> <model_dense.h>")
+    data = load(sys.argv[1])
+    network = layers(data)
+    with open(sys.argv[2], "w") as out:
+        out.write(generate(sys.argv[1].split("/")[-1], data, network))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,144 @@
+/*
+ * Host check of the CBOR telemetry against tools/cbor_vectors.json.
+ * The input of every vector is encoded with main/pump_data.c (cbor.c and telemetry.c underneath) and
+ * the bytes are compared with the "cbor" of the vector. Version 1 vectors predate the boot number,
+ * they are encoded with the version 1 layout from the same field table. Built by run.sh.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pump_data.h"
+
+#define MESSAGE_MAX     512
+
+typedef struct{
+    const char* name;
+    uint32_t version;
+    pump_data_header_t header;      //Version 1: only uptime_ms, and only in a batch.
+    uint16_t count;                 //1 for a single sample.
+    JSON_DATA_t samples[3];
+}vector_t;
+
+static const vector_t vectors[] = {
+    { "sample_normal",      1, { 0, 0 }, 1, { { true, 12.34f, 0.5f, 123456.789f, false, 0 } } },
+    { "sample_off_anomaly", 1, { 0, 0 }, 1, { { false, 0.0f, -0.25f, 70000.5f, true, 0 } } },
+    { "sample_half_limits", 1, { 0, 0 }, 1, { { true, 65504.0f, 100000.0f, 1e-7f, false, 0 } } },
+    { "batch_3",            1, { 0, 3600000 }, 3, {
+        { true, 10.5f, 1.25f, 1000.0f, false, 3590000 },
+        { true, 10.75f, 1.5f, 1002.5f, false, 3595000 },
+        { true, 11.0f, 1.75f, 1005.0f, true, 3600000 } } },
+    { "sample_boot",        2, { 3, 65000 }, 1, { { true, 12.34f, 0.5f, 123456.789f, false, 5000 } } },
+    { "batch_boot_3",       2, { 3, 65000 }, 3, {
+        { true, 12.34f, 0.5f, 123456.789f, false, 5000 },
+        { true, 12.5f, 0.5f, 123460.0f, false, 10000 },
+        { false, 0.0f, 0.0f, 123461.0f, true, 15000 } } },
+};
+
+//Version 1: {0: 1, fields} for a sample, {0: 1, 1: uptime_ms, 2: t0, 3: dt, columns} for a batch.
+static size_t encode_v1(const vector_t* v, uint8_t* buf, size_t size){
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, size);
+    if(v->count == 1){
+        cbor_map(&w, 1 + PUMP_DATA_FIELDS);
+        cbor_uint(&w, TELEMETRY_KEY_VERSION);
+        cbor_uint(&w, 1);
+        telemetry_write_cbor_fields(&w, pump_data_fields, PUMP_DATA_FIELDS, &v->samples[0]);
+        return cbor_writer_finish(&w);
+    }
+    cbor_map(&w, 4 + PUMP_DATA_FIELDS);
+    cbor_uint(&w, TELEMETRY_KEY_VERSION);
+    cbor_uint(&w, 1);
+    cbor_uint(&w, CBOR_KEY_UPTIME);
+    cbor_int(&w, v->header.uptime_ms);
+    cbor_uint(&w, CBOR_KEY_T0);
+    cbor_int(&w, v->samples[0].time_ms);
+    cbor_uint(&w, CBOR_KEY_DT);
+    cbor_array(&w, v->count);
+    for(uint16_t n = 0; n < v->count; n++){
+        cbor_int(&w, v->samples[n].time_ms - v->samples[0].time_ms);
+    }
+    telemetry_write_cbor_columns(&w, pump_data_fields, PUMP_DATA_FIELDS, v->samples, sizeof(JSON_DATA_t), v->count);
+    return cbor_writer_finish(&w);
+}
+
+static size_t encode(const vector_t* v, uint8_t* buf, size_t size){
+    if(v->version == 1){
+        return encode_v1(v, buf, size);
+    }
+    if(v->count == 1){
+        return sample_to_cbor(&v->header, &v->samples[0], buf, size);
+    }
+    return batch_to_cbor(&v->header, v->samples, v->count, buf, size);
+}
+
+static char* read_file(const char* path){
+    FILE* file = fopen(path, "rb");
+    if(file == NULL){
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* text = malloc(length + 1);
+    if((text != NULL) && (fread(text, 1, length, file) == (size_t)length)){
+        text[length] = '\0';
+    }else{
+        free(text);
+        text = NULL;
+    }
+    fclose(file);
+    return text;
+}
+
+//The "cbor" hex string of the named vector, copied into hex.
+static int expected_hex(const char* text, const char* name, char* hex, size_t size){
+    char key[64];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    const char* entry = strstr(text, key);
+    const char* cbor = entry ? strstr(entry, "\"cbor\": \"") : NULL;
+    if(cbor == NULL){
+        return -1;
+    }
+    cbor += strlen("\"cbor\": \"");
+    const char* end = strchr(cbor, '"');
+    if((end == NULL) || ((size_t)(end - cbor) >= size)){
+        return -1;
+    }
+    memcpy(hex, cbor, end - cbor);
+    hex[end - cbor] = '\0';
+    return 0;
+}
+
+int main(int argc, char** argv){
+    if(argc != 2){
+        printf("usage: cbor_check tools/cbor_vectors.json\n");
+        return 2;
+    }
+    char* text = read_file(argv[1]);
+    if(text == NULL){
+        printf("cannot read %s\n", argv[1]);
+        return 2;
+    }
+    int failed = 0;
+    const int count = sizeof(vectors) / sizeof(vectors[0]);
+    for(int i = 0; i < count; i++){
+        uint8_t buf[MESSAGE_MAX];
+        char hex[2 * MESSAGE_MAX + 1];
+        char expected[2 * MESSAGE_MAX + 1];
+        size_t length = encode(&vectors[i], buf, sizeof(buf));
+        for(size_t n = 0; n < length; n++){
+            sprintf(&hex[2 * n], "%02x", buf[n]);
+        }
+        hex[2 * length] = '\0';
+        if(expected_hex(text, vectors[i].name, expected, sizeof(expected)) != 0){
+            printf("FAIL %s: not in %s\n", vectors[i].name, argv[1]);
+            failed++;
+        }else if((length == 0) || (strcmp(hex, expected) != 0)){
+            printf("FAIL %s:\n  encoded  %s\n  expected %s\n", vectors[i].name, hex, expected);
+            failed++;
+        }
+    }
+    printf("%d vectors: %s\n", count, failed ? "MISMATCH" : "encoders match tools/cbor_vectors.json");
+    free(text);
+    return failed ? 1 : 0;
+}
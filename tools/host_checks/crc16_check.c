@@ -0,0 +1,101 @@
+/*
+ * Host check of the Modbus RTU CRC16 engines of mbcrc.c (CONFIG_FMB_CRC16_ENGINE).
+ * The byte table, slicing-by-4 and slicing-by-8 builds are compared with a bitwise CRC16/MODBUS
+ * on random frames at random alignments, then timed on 256-byte frames. Built by run.sh.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "port.h"
+
+USHORT crc16_byte_table(UCHAR* frame, USHORT len);
+USHORT crc16_slice4(UCHAR* frame, USHORT len);
+USHORT crc16_slice8(UCHAR* frame, USHORT len);
+
+typedef USHORT (*crc16_fn_t)(UCHAR*, USHORT);
+
+static const struct{
+    const char* name;
+    crc16_fn_t fn;
+}engines[] = {
+    { "byte table", crc16_byte_table },
+    { "slicing-by-4", crc16_slice4 },
+    { "slicing-by-8", crc16_slice8 },
+};
+#define ENGINE_COUNT    (sizeof(engines) / sizeof(engines[0]))
+
+#define FRAMES          200000
+#define FRAME_MAX       256
+#define BENCH_FRAMES    2000000
+
+//Reference: reflected polynomial 0xA001, initial value 0xFFFF, one bit at a time.
+static USHORT crc16_bitwise(const UCHAR* frame, size_t len){
+    uint16_t crc = 0xFFFF;
+    for(size_t i = 0; i < len; i++){
+        crc ^= frame[i];
+        for(int bit = 0; bit < 8; bit++){
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+static double now_s(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void){
+    static UCHAR buffer[FRAME_MAX + 8];
+    int failed = 0;
+
+    UCHAR check[] = "123456789";
+    for(size_t e = 0; e < ENGINE_COUNT; e++){
+        USHORT crc = engines[e].fn(check, 9);
+        if(crc != 0x4B37){
+            printf("FAIL %s: check value 0x%04X, expected 0x4B37\n", engines[e].name, crc);
+            failed++;
+        }
+    }
+
+    srand(1);
+    for(int n = 0; n < FRAMES; n++){
+        size_t len = rand() % (FRAME_MAX + 1);
+        size_t align = rand() % 8;
+        for(size_t i = 0; i < len; i++){
+            buffer[align + i] = (UCHAR)rand();
+        }
+        USHORT expected = crc16_bitwise(&buffer[align], len);
+        for(size_t e = 0; e < ENGINE_COUNT; e++){
+            USHORT crc = engines[e].fn(&buffer[align], (USHORT)len);
+            if(crc != expected){
+                if(failed < 10){
+                    printf("FAIL %s: %zu bytes at +%zu, 0x%04X expected 0x%04X\n", engines[e].name, len, align, crc, expected);
+                }
+                failed++;
+            }
+        }
+    }
+    printf("%d frames of 0-%d bytes: %s\n", FRAMES, FRAME_MAX, failed ? "MISMATCH" : "all engines match");
+
+    for(size_t i = 0; i < FRAME_MAX; i++){
+        buffer[i] = (UCHAR)i;
+    }
+    double base = 0.0;
+    for(size_t e = 0; e < ENGINE_COUNT; e++){
+        volatile USHORT sink = 0;
+        double start = now_s();
+        for(int n = 0; n < BENCH_FRAMES; n++){
+            buffer[0] = (UCHAR)n;
+            sink ^= engines[e].fn(buffer, FRAME_MAX);
+        }
+        double ns = (now_s() - start) * 1e9 / BENCH_FRAMES;
+        if(e == 0){
+            base = ns;
+        }
+        printf("%-14s %7.1f ns per %d-byte frame, %.2fx\n", engines[e].name, ns, FRAME_MAX, base / ns);
+    }
+    return failed ? 1 : 0;
+}
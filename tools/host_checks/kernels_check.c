@@ -0,0 +1,120 @@
+/*
+ * Host check of the autoencoder pre and post processing kernels of model_kernels.c.
+ * The _opt versions are compared with the _ansi references on random batches of 1-8 rows and
+ * 1-64 columns, which covers the 3 inputs of the shipped model (tail loop only) and the wider
+ * feature vectors (4-wide loop and tail). Then _ansi is timed against the dispatch the firmware
+ * uses with CONFIG_NN_OPTIMIZED (scale_rows_f32/mae_rows_f32, _opt from 4 columns). Built by run.sh.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "model_kernels.h"
+
+#define ROWS_MAX        8
+#define COLS_MAX        64
+#define BATCHES         200000
+#define BENCH_BATCHES   2000000
+#define BENCH_PASSES    5
+#define MAE_TOLERANCE   1e-6f           //Relative, the _opt sum is reassociated over four accumulators.
+
+static float random_value(void){
+    return (float)rand() / RAND_MAX * 2.0f - 1.0f;
+}
+
+static double now_s(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(int rows, int cols){
+    static float in[ROWS_MAX * COLS_MAX], out[ROWS_MAX * COLS_MAX], scale[COLS_MAX], offset[COLS_MAX];
+    float mae[ROWS_MAX];
+    for(int i = 0; i < rows * cols; i++){
+        in[i] = random_value();
+    }
+    for(int col = 0; col < cols; col++){
+        scale[col] = random_value();
+        offset[col] = random_value();
+    }
+    double ns[2][2] = { { 1e9, 1e9 }, { 1e9, 1e9 } };
+    volatile float sink = 0.0f;
+    //Best of BENCH_PASSES, both arms in turn, so a few ns per batch are not lost in the noise.
+    for(int pass = 0; pass < BENCH_PASSES; pass++){
+        for(int opt = 0; opt < 2; opt++){
+            double start = now_s();
+            for(int n = 0; n < BENCH_BATCHES; n++){
+                in[0] = (float)n;
+                if(opt){
+                    scale_rows_f32(in, out, rows, cols, scale, offset);
+                }else{
+                    scale_rows_f32_ansi(in, out, rows, cols, scale, offset);
+                }
+                sink += out[rows * cols - 1];
+            }
+            ns[opt][0] = fmin(ns[opt][0], (now_s() - start) * 1e9 / BENCH_BATCHES);
+            start = now_s();
+            for(int n = 0; n < BENCH_BATCHES; n++){
+                in[0] = (float)n;
+                if(opt){
+                    mae_rows_f32(in, out, rows, cols, mae);
+                }else{
+                    mae_rows_f32_ansi(in, out, rows, cols, mae);
+                }
+                sink += mae[rows - 1];
+            }
+            ns[opt][1] = fmin(ns[opt][1], (now_s() - start) * 1e9 / BENCH_BATCHES);
+        }
+    }
+    printf("%d x %-3d scale %6.1f / %6.1f ns (%.2fx), mae %6.1f / %6.1f ns (%.2fx)\n", rows, cols,
+           ns[0][0], ns[1][0], ns[0][0] / ns[1][0], ns[0][1], ns[1][1], ns[0][1] / ns[1][1]);
+}
+
+int main(void){
+    static float a[ROWS_MAX * COLS_MAX], b[ROWS_MAX * COLS_MAX], scale[COLS_MAX], offset[COLS_MAX];
+    static float out_ansi[ROWS_MAX * COLS_MAX], out_opt[ROWS_MAX * COLS_MAX];
+    float mae_ansi[ROWS_MAX], mae_opt[ROWS_MAX];
+    int failed = 0;
+
+    srand(1);
+    for(int n = 0; n < BATCHES; n++){
+        int rows = 1 + rand() % ROWS_MAX;
+        int cols = 1 + rand() % COLS_MAX;
+        for(int i = 0; i < rows * cols; i++){
+            a[i] = random_value();
+            b[i] = random_value();
+        }
+        for(int col = 0; col < cols; col++){
+            scale[col] = random_value();
+            offset[col] = random_value();
+        }
+        scale_rows_f32_ansi(a, out_ansi, rows, cols, scale, offset);
+        scale_rows_f32_opt(a, out_opt, rows, cols, scale, offset);
+        for(int i = 0; i < rows * cols; i++){
+            if(out_opt[i] != out_ansi[i]){
+                if(failed < 10){
+                    printf("FAIL scale %d x %d [%d]: %g expected %g\n", rows, cols, i, out_opt[i], out_ansi[i]);
+                }
+                failed++;
+            }
+        }
+        mae_rows_f32_ansi(a, b, rows, cols, mae_ansi);
+        mae_rows_f32_opt(a, b, rows, cols, mae_opt);
+        for(int row = 0; row < rows; row++){
+            if(fabsf(mae_opt[row] - mae_ansi[row]) > MAE_TOLERANCE * fabsf(mae_ansi[row])){
+                if(failed < 10){
+                    printf("FAIL mae %d x %d row %d: %g expected %g\n", rows, cols, row, mae_opt[row], mae_ansi[row]);
+                }
+                failed++;
+            }
+        }
+    }
+    printf("%d batches of 1-%d x 1-%d: %s\n", BATCHES, ROWS_MAX, COLS_MAX, failed ? "MISMATCH" : "_opt matches _ansi");
+
+    printf("ansi / dispatch per batch:\n");
+    bench(1, 3);                //Shipped model, one vector.
+    bench(4, 3);                //Shipped model, INFERENCE_BATCH.
+    bench(4, 39);               //Window statistics and band energies of the three axes.
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,8 @@
+/* Host shim of the esp-modbus mbconfig.h, the engine is picked with -DCONFIG_FMB_CRC16_*. */
+#ifndef _HOST_MBCONFIG_H_
+#define _HOST_MBCONFIG_H_
+
+#define MB_MASTER_RTU_ENABLED   1
+#define MB_SLAVE_RTU_ENABLED    0
+
+#endif
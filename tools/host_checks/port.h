@@ -0,0 +1,15 @@
+/* Host shim of the esp-modbus port.h, just what mbcrc.c needs. */
+#ifndef _HOST_PORT_H_
+#define _HOST_PORT_H_
+
+#include <stdint.h>
+
+typedef uint8_t     UCHAR;
+typedef int8_t      CHAR;
+typedef uint16_t    USHORT;
+typedef int16_t     SHORT;
+typedef uint32_t    ULONG;
+typedef int32_t     LONG;
+typedef uint8_t     BOOL;
+
+#endif
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Host checks of the firmware kernels, no ESP-IDF needed:
+#   crc16_check    the three CRC16 engines of esp-modbus mbcrc.c against a bitwise CRC, and their speed
+#   kernels_check  the _opt kernels of main/model_kernels.c against the _ansi ones, and their speed
+#   cbor_check     the CBOR telemetry of main/pump_data.c against tools/cbor_vectors.json
+#
+#   sh tools/host_checks/run.sh
+set -e
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$HERE/../.." && pwd)
+OUT=${TMPDIR:-/tmp}/host_checks
+CC=${CC:-cc}
+CFLAGS="-O2 -Wall -I$HERE"
+mkdir -p "$OUT"
+
+CRC="$ROOT/managed_components/espressif__esp-modbus/freemodbus/modbus/rtu/mbcrc.c"
+$CC $CFLAGS -DusMBCRC16=crc16_byte_table -c "$CRC" -o "$OUT/crc_byte.o"
+$CC $CFLAGS -DCONFIG_FMB_CRC16_SLICE4=1 -DusMBCRC16=crc16_slice4 -c "$CRC" -o "$OUT/crc_slice4.o"
+$CC $CFLAGS -DCONFIG_FMB_CRC16_SLICE8=1 -DusMBCRC16=crc16_slice8 -c "$CRC" -o "$OUT/crc_slice8.o"
+$CC $CFLAGS "$HERE/crc16_check.c" "$OUT"/crc_*.o -o "$OUT/crc16_check"
+"$OUT/crc16_check"
+
+$CC $CFLAGS -I"$ROOT/main" "$HERE/kernels_check.c" "$ROOT/main/model_kernels.c" -lm -o "$OUT/kernels_check"
+"$OUT/kernels_check"
+
+$CC $CFLAGS -I"$ROOT/main" "$HERE/cbor_check.c" "$ROOT/main/pump_data.c" "$ROOT/main/telemetry.c" "$ROOT/main/cbor.c" \
+    -lm -o "$OUT/cbor_check"
+"$OUT/cbor_check" "$ROOT/tools/cbor_vectors.json"
@@ -0,0 +1,2 @@
+/* Host shim of the ESP-IDF sdkconfig.h, with the options of the firmware sdkconfig that the checks use. */
+#define CONFIG_NN_OPTIMIZED 1